@@ -0,0 +1,32 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#version 330 core
+
+out vec3 color;
+
+in vec2 frag_texcoord;
+
+uniform sampler2D atlas;
+
+void main() {
+    vec4 texel = texture(atlas, frag_texcoord);
+    if (texel.a < 0.5) {
+        discard;
+    }
+
+	color = texel.rgb;
+}
\ No newline at end of file
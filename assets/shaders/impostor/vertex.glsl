@@ -0,0 +1,31 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#version 330 core
+
+layout(location = 0) in vec3 vertex_position;
+layout(location = 1) in vec3 vertex_texcoord;
+
+out vec2 frag_texcoord;
+
+uniform mat4 world_transform;
+uniform mat4 model_transform;
+
+void main() {
+    gl_Position = world_transform * model_transform * vec4(vertex_position, 1.0);
+
+    frag_texcoord = vertex_texcoord.xy;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "gameobject.h"
+#include "proctree.h"
+
+// A handful of proctree variants of one species, generated and uploaded once.
+// Every variant is drawn with a single instanced call over all of its placements.
+struct TreeVariantPool {
+	TreeProperties properties;
+	std::vector<Mesh> meshes{};
+	std::vector<std::vector<glm::mat4x4>> instances{};
+
+	TreeVariantPool(const TreeProperties& properties, int variants);
+
+	size_t place(Transform transform);
+	void place(size_t variant, Transform transform);
+
+	std::vector<std::unique_ptr<GameObject>> build();
+
+private:
+	size_t placed = 0;
+};
+
+// Unique trees generated in parallel and packed into one shared set of buffers, with positions baked
+// into the vertices. The whole forest is a single multi-draw call; every tree keeps its own range.
+// properties is cycled when it holds fewer entries than positions; without any the forest is empty.
+std::unique_ptr<GameObject> createForest(const std::vector<glm::vec3>& positions, const std::vector<TreeProperties>& properties);
@@ -20,6 +20,8 @@ limitations under the License.
 #include "shader.h"
 #include "mesh.h"
 
+struct Camera;
+
 struct GameObject {
 	Transform transform;
 	Mesh mesh;
@@ -27,4 +29,8 @@ struct GameObject {
 	virtual ~GameObject() = default;
 
 	virtual void update(double dt) {}
+
+	virtual Mesh& getMesh(const Camera& camera) {
+		return mesh;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,33 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+#include "mesh.h"
+
+// Views of a mesh rendered around its vertical axis into one atlas row, each paired with a fixed
+// quad perpendicular to its bake direction that samples its cell. view() picks the quad baked
+// closest to the direction it is seen from; nothing turns to face the camera.
+struct Impostor {
+	GLuint texture{};
+	std::vector<Mesh> views{};
+
+	Mesh& view(const glm::vec3& direction);
+};
+
+// the mesh must still hold its CPU geometry, which sizes the views
+Impostor bakeImpostor(Mesh& mesh, int views, int resolution);
@@ -16,8 +16,13 @@ limitations under the License.
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <string>
 #include "gameobject.h"
 
-std::unique_ptr<GameObject> createLObject(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations, float angle);
\ No newline at end of file
+std::unique_ptr<GameObject> createLObject(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations, float angle);
+
+// The fully rewritten sentence, for analysis or caching; createLObject never needs it. Every step
+// sizes its output with a per-symbol length table and a prefix sum, then copies in parallel.
+std::string expandLSystem(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations);
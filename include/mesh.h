@@ -23,9 +23,43 @@ limitations under the License.
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
 
+#include <memory>
 #include <vector>
 
+#include "upload_ring.h"
+#include "vertex_format.h"
+
+// A sub-range of a shared index buffer; its indices are relative to base_vertex.
+struct DrawRange {
+	size_t first_index = 0;
+	GLsizei count = 0;
+	GLint base_vertex = 0;
+};
+
+// A cluster of neighbouring triangles, contiguous in the index buffer. Its normal cone holds the
+// normals of all its triangles, so it can be rejected as a whole once it faces away.
+struct Meshlet {
+	uint32_t first_index = 0;
+	uint32_t count = 0;
+
+	glm::vec3 center{};
+	float radius = 0;
+
+	glm::vec3 cone_axis{0, 0, 1};
+	// sine of the cone's half angle, 1 when the cone is too wide to ever cull
+	float cone_cutoff = 1;
+};
+
+// CPU side of a mesh, kept only by whoever still needs it after upload.
+struct Geometry {
+	std::vector<glm::vec3> vertices{};
+	std::vector<glm::vec3> colors{};
+	std::vector<glm::vec3> normals{};
+	std::vector<uint32_t> indices{};
+};
+
 struct Mesh {
 	GLuint shader;
 	GLuint VAO{};
@@ -33,13 +67,26 @@ struct Mesh {
 	GLuint CBO{};
 	GLuint NBO{};
 	GLuint IBO{};
+	GLuint TBO{};
+	GLuint texture{};
 
 	GLenum mode = GL_TRIANGLES;
+	GLsizei instances = 0;
+	bool instanced = false;
 
-	std::vector<glm::vec3> vertices{};
-	std::vector<glm::vec3> colors{};
-	std::vector<glm::vec3> normals{};
-	std::vector<uint32_t> indices{};
+	// GL_UNSIGNED_SHORT whenever every index fits
+	GLenum index_type = GL_UNSIGNED_INT;
+
+	// shared by copies of the mesh instead of being duplicated; empty after dropGeometry
+	std::shared_ptr<const Geometry> geometry{};
+	GLsizei index_count = 0;
+
+	std::vector<GLsizei> counts{};
+	std::vector<const void*> offsets{};
+	std::vector<GLint> base_vertices{};
+
+	// drawn through ranges; empty unless the mesh was built with meshlets
+	std::vector<Meshlet> meshlets{};
 
 	Mesh();
 
@@ -47,6 +94,20 @@ struct Mesh {
 	void setColors(const std::vector<glm::vec3> &colors);
 	void setNormals(const std::vector<glm::vec3> &normals);
 	void setIndices(const std::vector<uint32_t>& indices);
+	// one interleaved buffer in the given format instead of a float buffer per attribute
+	void setGeometry(const VertexFormat& format, std::shared_ptr<const Geometry> geometry);
+	void dropGeometry();
+	// streamed vertices encoded straight into the ring; indices still come from setIndices
+	void setVertices(const VertexFormat& format, const UploadRing& ring, const UploadAllocation& vertices);
+	void setInstances(const std::vector<glm::mat4x4>& transforms);
+	// per-frame transforms written into the ring, read from there instead of the mesh's own buffer
+	void setInstances(const UploadRing& ring, const UploadAllocation& transforms);
+	void setRanges(const std::vector<DrawRange>& ranges);
+	// draws every meshlet until the first cull
+	void setMeshlets(std::vector<Meshlet> meshlets);
+	// Keeps the meshlets that are inside the frustum and not facing away, merging neighbours into one
+	// range. The camera position is in the mesh's own space. Returns how many meshlets are left.
+	size_t cull(const glm::mat4x4& model_view_projection, const glm::vec3& camera_position);
 
 	void draw();
 };
\ No newline at end of file
@@ -30,8 +30,15 @@ struct MeshBuilder {
 	std::vector<glm::vec3> normals{};
 	std::vector<uint32_t> indices{};
 
+	VertexFormat format{};
+	// whether the built mesh keeps its CPU geometry after upload
+	bool keep_geometry = true;
+	// when set, build() splits the mesh into meshlets of at most this many triangles for culling
+	size_t meshlet_triangles = 0;
+
 	void clear();
 
+	// moves the geometry into the mesh, leaving the builder empty
 	Mesh build();
 
 	void triangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
@@ -0,0 +1,56 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+#include "mesh_builder.h"
+
+// Before and after numbers of optimizeMesh. ACMR is the average number of vertex shader runs per
+// triangle with a 16 entry FIFO post-transform cache: 3 is no reuse, 0.5 the best a grid can do.
+struct MeshOptimization {
+	size_t vertices_before = 0;
+	size_t vertices_after = 0;
+	float acmr_before = 0;
+	float acmr_after = 0;
+};
+
+float analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size = 16);
+
+// Merges vertices whose position, colour and normal are bit for bit equal and returns how many are left.
+size_t weldVertices(MeshBuilder& builder);
+
+// Forsyth's linear-speed triangle order for vertex cache locality.
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count);
+
+// Splits a cache-optimised order into clusters and draws the ones facing away from the mesh centre
+// first, so outer surfaces occlude inner ones. Threshold bounds the ACMR it may give up.
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices, float threshold = 1.05f);
+
+// Renumbers vertices in the order the indices first use them and drops unreferenced ones.
+void optimizeVertexFetch(MeshBuilder& builder);
+
+// Grows clusters of at most max_triangles neighbouring triangles with similar normals, makes each
+// contiguous in the index buffer and cache-optimises it. Clusters facing away from the mesh centre
+// come first, as in optimizeOverdraw. Vertex order is left alone.
+std::vector<Meshlet> buildMeshlets(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices, size_t max_triangles = 128);
+
+// All of the above for an indexed triangle list, in the order they have to run.
+MeshOptimization optimizeMesh(MeshBuilder& builder, bool overdraw = false);
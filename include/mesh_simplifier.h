@@ -0,0 +1,47 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh_builder.h"
+
+struct SimplifyOptions {
+	// stop once the mesh is down to this many triangles
+	size_t target_triangles = 0;
+	// or once the cheapest collapse would move the surface further than this fraction of the mesh size
+	float target_error = 1.0f;
+	// keep open edges in place, so neighbouring chunks still meet along their seams
+	bool lock_border = false;
+	// what a unit of colour or normal difference costs, in squared fractions of the mesh size
+	float color_weight = 1.0f;
+	float normal_weight = 0.1f;
+};
+
+// Garland-Heckbert edge collapse onto existing vertices, so colours and normals never need to be
+// interpolated. Vertices that share a position with another vertex (attribute seams) and non-manifold
+// vertices never move. Returns the error reached, in the same units as target_error; unreferenced
+// vertices are left for optimizeVertexFetch to drop.
+float simplifyMesh(MeshBuilder& builder, const SimplifyOptions& options);
+
+// levels meshes after the original, each with ratio times the triangles of the one before,
+// simplified from each other and cache optimised.
+std::vector<MeshBuilder> simplifyLodChain(const MeshBuilder& builder, size_t levels, float ratio = 0.5f, const SimplifyOptions& options = {});
+
+// One chain per mesh, built in parallel.
+std::vector<std::vector<MeshBuilder>> simplifyLodChains(const std::vector<MeshBuilder>& builders, size_t levels, float ratio = 0.5f, const SimplifyOptions& options = {});
@@ -20,15 +20,15 @@ limitations under the License.
 #include "gameobject.h"
 
 struct Planet : public GameObject {
-	std::vector<glm::vec3> vertices;
-	std::vector<uint32_t> indices;
+	// the same CPU geometry the mesh was built from
+	std::shared_ptr<const Geometry> geometry;
 
 	int level_of_detail;
 	float radius;
 	float height_variation;
 
 
-	Planet(const std::vector<glm::vec3>& vertices, const std::vector<uint32_t>& indices, int level_of_detail, float radius, float height_variation) : vertices(vertices), indices(indices), level_of_detail(level_of_detail), radius(radius), height_variation(height_variation) {}
+	Planet(std::shared_ptr<const Geometry> geometry, int level_of_detail, float radius, float height_variation) : geometry(std::move(geometry)), level_of_detail(level_of_detail), radius(radius), height_variation(height_variation) {}
 
 	glm::vec3 getPoint(const glm::vec3& point);
 };
@@ -19,6 +19,9 @@ limitations under the License.
 #include <memory>
 #include <optional>
 #include "gameobject.h"
+#include "impostor.h"
+
+struct MeshBuilder;
 
 struct TreeProperties {
 	float clump_max = 0.454f;
@@ -33,6 +36,7 @@ struct TreeProperties {
 	int tree_steps = 5;
 	float taper_rate = 0.947f;
 	float twist_rate = 3.02f;
+	// rounded up to even
 	int segments = 6;
 	int levels = 5;
 	float sweep_amount = 0.01f * 5;
@@ -42,14 +46,45 @@ struct TreeProperties {
 	float grow_amount = 0.235f;
 	float twig_scale = 0.39f;
 	int seed = 262;
-	int rseed = 0;
-
-	float next(float fixed) {
-		if (fixed == 0) {
-			fixed = (float) rseed++;
-		}
-		return std::abs(std::cos(fixed + fixed * fixed));
-	}
 };
 
-std::unique_ptr<GameObject> createProcTree(const glm::vec3& position, const std::optional<TreeProperties>& properties = std::nullopt);
\ No newline at end of file
+struct TreeLod {
+	int meshes = 2;
+	int impostor_views = 8;
+	int impostor_resolution = 128;
+	float screen_size = 0.5f;
+};
+
+// Full-detail mesh, progressively pruned meshes and a baked impostor. Each level is used while the
+// tree's projected size stays above screen_size, halved for every level after the first.
+struct ProcTreeLod : public GameObject {
+	std::vector<Mesh> levels{};
+	Impostor impostor{};
+	float radius = 0;
+	float screen_size = 0;
+
+	Mesh& getMesh(const Camera& camera) override;
+};
+
+// Branch data of a proctree without rings or geometry, one entry per branch in pre-order. Radii are
+// the ones the mesh rings use, clamped to the branch length. Twigs have level -1; the bounds include
+// the trunk base at the origin.
+struct TreeSkeleton {
+	std::vector<glm::vec3> heads{};
+	std::vector<float> radii{};
+	std::vector<int> levels{};
+	std::vector<int> parents{};
+	glm::vec3 min{};
+	glm::vec3 max{};
+	size_t forks = 0;
+	size_t twigs = 0;
+	float total_length = 0;
+};
+
+TreeSkeleton generateProcTreeSkeleton(const TreeProperties& properties);
+std::vector<TreeSkeleton> generateProcTreeSkeletons(const std::vector<TreeProperties>& properties);
+
+// Fills an empty builder with the tree in its local space, without creating any GL objects.
+void generateProcTree(const TreeProperties& properties, MeshBuilder& builder);
+
+std::unique_ptr<GameObject> createProcTree(const glm::vec3& position, const std::optional<TreeProperties>& properties = std::nullopt, const std::optional<TreeLod>& lod = std::nullopt);
\ No newline at end of file
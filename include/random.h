@@ -0,0 +1,61 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+// Counter-based generator: every value is a pure function of (seed, stream, index), so branches,
+// leaves or chunks can draw their numbers in any order and on any thread with identical results.
+struct Random {
+	uint64_t seed = 0;
+	uint64_t stream = 0;
+
+	Random() = default;
+	explicit Random(uint64_t seed, uint64_t stream = 0) : seed{seed}, stream{stream} {}
+
+	static uint64_t mix(uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111ebull;
+		x ^= x >> 31;
+		return x;
+	}
+
+	static uint64_t hash(uint64_t seed, uint64_t stream, uint64_t index) {
+		uint64_t key = mix(seed + 0x9e3779b97f4a7c15ull) ^ mix(stream * 0xd1b54a32d192ed03ull + 0x2545f4914f6cdd1dull);
+		return mix(key + index * 0x9e3779b97f4a7c15ull);
+	}
+
+	// an independent generator for a sub-task, e.g. one per chunk
+	Random fork(uint64_t child) const {
+		return Random{hash(seed, stream, child), stream};
+	}
+
+	uint32_t bits(uint64_t index) const {
+		return static_cast<uint32_t>(hash(seed, stream, index) >> 32);
+	}
+
+	// uniform in [0, 1)
+	float value(uint64_t index) const {
+		return static_cast<float>(bits(index) >> 8) * (1.0f / 16777216.0f);
+	}
+
+	float range(uint64_t index, float min, float max) const {
+		return min + (max - min) * value(index);
+	}
+};
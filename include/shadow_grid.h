@@ -0,0 +1,49 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Coarse occlusion voxels for light-aware growth. Every node casts a pyramid of shadow into the
+// layers below it, widening by one voxel and weakening by falloff per layer, so adding a node costs
+// the same no matter how large the tree or stand already is. Positions outside the grid are lit.
+struct ShadowGrid {
+	glm::vec3 origin;
+	float cell_size;
+	int width;
+	int height;
+	int length;
+	int depth;
+	float falloff;
+	std::vector<float> shadow{};
+
+	ShadowGrid(const glm::vec3& min, const glm::vec3& max, float cell_size, int depth = 6, float falloff = 2.0f);
+
+	void cast(const glm::vec3& position);
+
+	// what is left of full_light at the voxel, never below zero
+	float exposure(const glm::vec3& position, float full_light) const;
+
+	// unit direction to the least shaded of the 26 neighbouring voxels, zero if none is lighter
+	glm::vec3 light(const glm::vec3& position) const;
+
+private:
+	bool voxel(const glm::vec3& position, int& x, int& y, int& z) const;
+	float at(int x, int y, int z) const;
+};
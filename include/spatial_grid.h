@@ -0,0 +1,64 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/vec3.hpp>
+
+// Hashed uniform grid of point ids. With the cell size at least the query radius, every point
+// within that radius lies in the 3x3x3 block of cells around the query.
+struct SpatialGrid {
+	float cell_size;
+	std::unordered_map<uint64_t, std::vector<uint32_t>> cells{};
+
+	explicit SpatialGrid(float cell_size) : cell_size{cell_size} {}
+
+	void insert(const glm::vec3& position, uint32_t id);
+	void clear();
+
+	template<typename F>
+	void query(const glm::vec3& position, F&& fn) const {
+		auto x = cell(position.x);
+		auto y = cell(position.y);
+		auto z = cell(position.z);
+
+		for (int64_t dx = -1; dx <= 1; dx++) {
+			for (int64_t dy = -1; dy <= 1; dy++) {
+				for (int64_t dz = -1; dz <= 1; dz++) {
+					auto it = cells.find(key(x + dx, y + dy, z + dz));
+					if (it == cells.end()) {
+						continue;
+					}
+					for (auto id : it->second) {
+						fn(id);
+					}
+				}
+			}
+		}
+	}
+
+private:
+	int64_t cell(float value) const {
+		return static_cast<int64_t>(std::floor(value / cell_size));
+	}
+
+	static uint64_t key(int64_t x, int64_t y, int64_t z);
+};
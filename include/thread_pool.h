@@ -0,0 +1,84 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct TaskGroup {
+	std::atomic<size_t> pending{0};
+};
+
+// Work-stealing pool: every worker pops its own queue from the back and steals from the
+// front of the others. Threads that wait on a group keep running queued tasks meanwhile,
+// so tasks may freely submit and wait on nested work.
+struct ThreadPool {
+	using Task = std::function<void()>;
+
+	explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const {
+		return workers.size() + 1;
+	}
+
+	void submit(TaskGroup& group, Task task);
+	void wait(TaskGroup& group);
+
+	template<typename F>
+	void parallel_for(size_t begin, size_t end, size_t grain, F&& fn) {
+		TaskGroup group{};
+		while (end - begin > grain) {
+			size_t next = begin + grain;
+			submit(group, [&fn, begin, next] { fn(begin, next); });
+			begin = next;
+		}
+		if (begin < end) {
+			fn(begin, end);
+		}
+		wait(group);
+	}
+
+	static ThreadPool& instance();
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<std::pair<TaskGroup*, Task>> tasks;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic<size_t> queued{0};
+	bool running = true;
+
+	size_t current() const;
+	bool run(size_t self);
+	void work(size_t self);
+};
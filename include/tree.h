@@ -16,7 +16,34 @@ limitations under the License.
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <vector>
 #include "gameobject.h"
 
-extern std::unique_ptr<GameObject> createTree(const glm::vec3& position);
\ No newline at end of file
+struct ColonizationProperties {
+	int attraction_points = 500;
+	float crown_size = 50.0f;
+	float min_dist = 10.0f;
+	float max_dist = 25.0f;
+	int iterations = 1000;
+	uint64_t seed = 0;
+	int segments = 8;
+	float tip_radius = 0.1f;
+	float pipe_exponent = 2.5f;
+
+	// shadow propagation: buds bend towards light and stay dormant once their voxel is fully shaded
+	bool shadow = false;
+	float shadow_cell = 2.0f;
+	int shadow_depth = 6;
+	float full_light = 4.0f;
+	float light_weight = 0.5f;
+};
+
+extern std::unique_ptr<GameObject> createTree(const glm::vec3& position, const std::optional<ColonizationProperties>& properties = std::nullopt);
+
+// Grows one tree per position against a single shared point cloud, so neighbours compete for space.
+// Every position adds attraction_points to a crown-sized cube around itself; where cubes overlap
+// the earlier position's points win, so the density stays that of a single crown.
+extern std::vector<std::unique_ptr<GameObject>> createColonizationForest(const std::vector<glm::vec3>& positions, const std::optional<ColonizationProperties>& properties = std::nullopt);
@@ -0,0 +1,109 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+// What went through an UploadRing in one frame, or in all of them.
+struct UploadStats {
+	size_t bytes = 0;
+	size_t allocations = 0;
+	// allocations that had to wait for the GPU to finish with an older frame
+	size_t stalls = 0;
+	double stall_seconds = 0;
+	// lost to alignment and to skipping the end of the buffer when wrapping around
+	size_t padding = 0;
+	// requests bigger than what this frame has left of the ring, left to the caller
+	size_t failures = 0;
+
+	UploadStats& operator+=(const UploadStats& other);
+};
+
+// This frame's piece of the ring. data points at the mapped buffer, offset is where the GPU sees it.
+struct UploadAllocation {
+	void* data = nullptr;
+	GLintptr offset = 0;
+	GLsizeiptr size = 0;
+
+	explicit operator bool() const {
+		return data != nullptr;
+	}
+};
+
+// Streaming buffer for data that is rewritten every frame. With ARB_buffer_storage it is mapped
+// once, persistently and coherently, so generators write straight into it; each frame is fenced and
+// its bytes are only handed out again once the GPU has passed the fence. Without the extension
+// writes land in a CPU copy that flush() uploads with glBufferSubData.
+struct UploadRing {
+	GLuint buffer{};
+	size_t capacity;
+
+	UploadStats frame{};
+	UploadStats last_frame{};
+	UploadStats total{};
+
+	explicit UploadRing(size_t capacity);
+	~UploadRing();
+
+	UploadRing(const UploadRing&) = delete;
+	UploadRing& operator=(const UploadRing&) = delete;
+
+	bool persistent() const {
+		return mapped != nullptr;
+	}
+
+	// waits for older frames when the ring is full; empty when size can't fit even then
+	UploadAllocation allocate(size_t size, size_t alignment = 16);
+
+	template<typename T>
+	UploadAllocation upload(const std::vector<T>& values, size_t alignment = 16) {
+		auto allocation = allocate(values.size() * sizeof(T), alignment);
+		if (allocation) {
+			std::memcpy(allocation.data, values.data(), values.size() * sizeof(T));
+		}
+		return allocation;
+	}
+
+	// call before drawing from this frame's allocations; nothing to do for the persistent mapping
+	void flush();
+	// fences everything allocated since the last call and rolls the stats over
+	void endFrame();
+
+private:
+	struct Frame {
+		GLsync fence;
+		size_t bytes;
+	};
+
+	uint8_t* mapped = nullptr;
+	std::vector<uint8_t> shadow{};
+	std::vector<UploadAllocation> dirty{};
+
+	std::deque<Frame> frames{};
+	size_t head = 0;
+	// bytes between the oldest unfinished frame and head, this frame's included
+	size_t used = 0;
+	size_t pending = 0;
+
+	bool retire(bool wait);
+};
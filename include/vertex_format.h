@@ -0,0 +1,64 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// How positions, normals and colours are stored in a mesh's interleaved vertex buffer. Packed
+// types are widened by the vertex fetch, so shaders keep their vec3 inputs whatever the format.
+struct VertexFormat {
+	enum PositionType : uint8_t {
+		POSITION_FLOAT, // 12 bytes
+		POSITION_HALF // 8 bytes, only for meshes kept close to their own origin
+	};
+
+	enum NormalType : uint8_t {
+		NORMAL_FLOAT, // 12 bytes
+		NORMAL_PACKED // 4 bytes, signed 10:10:10:2
+	};
+
+	enum ColorType : uint8_t {
+		COLOR_FLOAT, // 12 bytes, any data the colour stream carries
+		COLOR_RGBA8 // 4 bytes, clamped to [0, 1]
+	};
+
+	PositionType position = POSITION_FLOAT;
+	NormalType normal = NORMAL_FLOAT;
+	ColorType color = COLOR_FLOAT;
+
+	// 20 bytes a vertex
+	static VertexFormat compact();
+	// 16 bytes a vertex
+	static VertexFormat local();
+
+	size_t normalOffset() const;
+	size_t colorOffset() const;
+	size_t stride() const;
+
+	// points attributes 0-2 of the bound vertex array at the bound array buffer, from offset on
+	void bind(size_t offset = 0) const;
+
+	// missing colours and normals are written as zero
+	std::vector<uint8_t> encode(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& colors, const std::vector<glm::vec3>& normals) const;
+	// the same into memory the caller owns, such as an upload ring, vertices.size() * stride() bytes
+	void encode(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& colors, const std::vector<glm::vec3>& normals, uint8_t* data) const;
+};
@@ -0,0 +1,122 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <algorithm>
+#include "forest.h"
+#include "mesh_builder.h"
+#include "thread_pool.h"
+
+TreeVariantPool::TreeVariantPool(const TreeProperties& properties, int variants) : properties{properties} {
+	// place() cycles through the variants, so there has to be one
+	variants = std::max(variants, 1);
+	meshes.reserve(static_cast<size_t>(variants));
+	instances.resize(static_cast<size_t>(variants));
+
+	for (int i = 0; i < variants; i++) {
+		auto variant = properties;
+		variant.seed = properties.seed + i;
+		meshes.push_back(createProcTree({0, 0, 0}, variant)->mesh);
+	}
+}
+
+size_t TreeVariantPool::place(Transform transform) {
+	size_t variant = placed % meshes.size();
+	place(variant, transform);
+	return variant;
+}
+
+void TreeVariantPool::place(size_t variant, Transform transform) {
+	instances[variant].push_back(transform.matrix());
+	placed++;
+}
+
+std::vector<std::unique_ptr<GameObject>> TreeVariantPool::build() {
+	std::vector<std::unique_ptr<GameObject>> objects{};
+
+	for (size_t i = 0; i < meshes.size(); i++) {
+		if (instances[i].empty()) {
+			continue;
+		}
+
+		auto object = std::make_unique<GameObject>();
+		object->mesh = meshes[i];
+		object->mesh.shader = Shader::find("instanced_wood");
+		object->mesh.setInstances(instances[i]);
+		objects.push_back(std::move(object));
+	}
+	return objects;
+}
+
+std::unique_ptr<GameObject> createForest(const std::vector<glm::vec3>& positions, const std::vector<TreeProperties>& properties) {
+	// no species to cycle through, nothing to draw
+	if (properties.empty()) {
+		auto object = std::make_unique<GameObject>();
+		object->mesh.shader = Shader::find("default_wood");
+		return std::move(object);
+	}
+
+	auto& pool = ThreadPool::instance();
+
+	std::vector<MeshBuilder> trees(positions.size());
+	pool.parallel_for(0, trees.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			generateProcTree(properties[i % properties.size()], trees[i]);
+		}
+	});
+
+	std::vector<DrawRange> ranges(trees.size());
+	size_t vertices_count = 0;
+	size_t indices_count = 0;
+	for (size_t i = 0; i < trees.size(); i++) {
+		ranges[i].first_index = indices_count;
+		ranges[i].count = static_cast<GLsizei>(trees[i].indices.size());
+		ranges[i].base_vertex = static_cast<GLint>(vertices_count);
+
+		vertices_count += trees[i].vertices.size();
+		indices_count += trees[i].indices.size();
+	}
+
+	MeshBuilder builder{};
+	builder.format = VertexFormat::compact();
+	builder.keep_geometry = false;
+	builder.vertices.resize(vertices_count);
+	builder.colors.resize(vertices_count);
+	builder.normals.resize(vertices_count);
+	builder.indices.resize(indices_count);
+
+	// indices stay local to their tree, base_vertex offsets them at draw time
+	pool.parallel_for(0, trees.size(), 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			auto& tree = trees[i];
+			size_t base = static_cast<size_t>(ranges[i].base_vertex);
+
+			for (size_t j = 0; j < tree.vertices.size(); j++) {
+				builder.vertices[base + j] = tree.vertices[j] + positions[i];
+			}
+			std::copy(tree.colors.begin(), tree.colors.end(), builder.colors.begin() + base);
+			std::copy(tree.normals.begin(), tree.normals.end(), builder.normals.begin() + base);
+			std::copy(tree.indices.begin(), tree.indices.end(), builder.indices.begin() + ranges[i].first_index);
+
+			tree = MeshBuilder{};
+		}
+	});
+
+	auto object = std::make_unique<GameObject>();
+	object->mesh = builder.build();
+	object->mesh.shader = Shader::find("default_wood");
+	object->mesh.setRanges(ranges);
+	return std::move(object);
+}
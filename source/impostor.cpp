@@ -0,0 +1,121 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "impostor.h"
+#include "shader.h"
+
+#include <cfloat>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+Mesh& Impostor::view(const glm::vec3& direction) {
+	auto angle = std::atan2(direction.x, direction.z);
+	auto step = static_cast<float>(M_PI * 2 / views.size());
+	auto index = static_cast<int>(std::round(angle / step)) % static_cast<int>(views.size());
+	if (index < 0) {
+		index += static_cast<int>(views.size());
+	}
+	return views[index];
+}
+
+Impostor bakeImpostor(Mesh& mesh, int views, int resolution) {
+	float bottom = FLT_MAX;
+	float top = -FLT_MAX;
+	float width = 0;
+	float radius = 0;
+
+	for (auto const& vertex : mesh.geometry->vertices) {
+		bottom = std::min(bottom, vertex.y);
+		top = std::max(top, vertex.y);
+		width = std::max(width, std::sqrt(vertex.x * vertex.x + vertex.z * vertex.z));
+		radius = std::max(radius, glm::length(vertex));
+	}
+
+	Impostor impostor{};
+
+	glGenTextures(1, &impostor.texture);
+	glBindTexture(GL_TEXTURE_2D, impostor.texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, resolution * views, resolution, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLuint depth{};
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, resolution * views, resolution);
+
+	GLuint framebuffer{};
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostor.texture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	glClearColor(0, 0, 0, 0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	auto shader = Shader::find("impostor_bake");
+	glm::mat4x4 model_matrix{1.0f};
+	glm::vec3 center{0, (bottom + top) * 0.5f, 0};
+	glm::vec3 up{0, 1, 0};
+
+	for (int i = 0; i < views; i++) {
+		auto angle = static_cast<float>(M_PI * 2 * i / views);
+		glm::vec3 forward{std::sin(angle), 0, std::cos(angle)};
+		glm::vec3 right = glm::cross(up, forward);
+
+		auto projection = glm::ortho(-width, width, bottom - center.y, top - center.y, 0.0f, radius * 6);
+		auto world_matrix = projection * glm::lookAt(center + forward * radius * 3.0f, center, up);
+
+		glViewport(resolution * i, 0, resolution, resolution);
+		glUseProgram(shader);
+		glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(world_matrix));
+		glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(model_matrix));
+		mesh.draw();
+
+		// the atlas cell goes into the colour stream, the view direction into the normals
+		float u0 = i / (float) views;
+		float u1 = (i + 1) / (float) views;
+
+		Mesh quad{};
+		quad.shader = Shader::find("impostor");
+		quad.texture = impostor.texture;
+		quad.setVertices({
+			glm::vec3{0, bottom, 0} - right * width,
+			glm::vec3{0, bottom, 0} + right * width,
+			glm::vec3{0, top, 0} + right * width,
+			glm::vec3{0, top, 0} - right * width
+		});
+		quad.setColors({{u0, 0, 0}, {u1, 0, 0}, {u1, 1, 0}, {u0, 1, 0}});
+		quad.setNormals({forward, forward, forward, forward});
+		quad.setIndices({0, 1, 2, 0, 2, 3});
+		impostor.views.push_back(quad);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &depth);
+
+	return impostor;
+}
@@ -16,102 +16,354 @@ limitations under the License.
 
 #include "lsystem.h"
 #include "mesh_builder.h"
+#include "thread_pool.h"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
 #include <map>
 #include <iostream>
-#include <stack>
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/euler_angles.hpp>
+#include <glm/mat3x3.hpp>
 
-//todo: generate solid mesh
-std::unique_ptr<GameObject> createLObject(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations, float angle) {
-	std::string sentence = axiom;
-	while (iterations > 0) {
-		iterations--;
+enum class op_t : uint8_t {
+	nop, draw, move, turn, push, pop
+};
 
-		std::string next_sentence{};
-		for (auto ch : sentence) {
-			auto it = rules.find(ch);
-			if (it != rules.end()) {
-				next_sentence.append(it->second);
-			} else {
-				next_sentence.push_back(ch);
-			}
-		}
-		sentence = next_sentence;
-	}
+// one compiled symbol: what the turtle does with it, plus the production it rewrites to
+// (rule 0 means none) while there are rewrite levels left
+struct instr_t {
+	op_t op;
+	uint8_t turn;
+	uint16_t rule;
+};
 
-	struct state_t {
-		glm::vec3 pos;
-		glm::vec3 rot;
+using program_t = std::vector<instr_t>;
 
-		glm::vec3 forward() {
-			auto matrix = glm::inverse(glm::eulerAngleXYZ(rot.x, rot.y, rot.z));
-			return glm::normalize(glm::vec3{matrix[1]});
-		}
-	};
+static glm::mat3 axisRotation(int axis, float angle) {
+	float c = std::cos(angle);
+	float s = std::sin(angle);
+	int u = (axis + 1) % 3;
+	int v = (axis + 2) % 3;
 
-	std::stack<state_t> stack{};
+	glm::mat3 rotation{1.0f};
+	rotation[u][u] = c;
+	rotation[u][v] = s;
+	rotation[v][u] = -s;
+	rotation[v][v] = c;
+	return rotation;
+}
 
-	state_t state{};
-	state.pos = {0, 0, 0};
-	state.rot = {0, 0, 0};
+static program_t compile(const std::string& text, const std::array<uint16_t, 256>& rule_of, size_t& depth) {
+	program_t program{};
+	program.reserve(text.size());
 
-	auto push = [&]() -> void {
-		stack.push(state);
-	};
-	auto pop = [&]() -> void {
-		state = stack.top();
-		stack.pop();
-	};
-
-	MeshBuilder builder{};
-
-	for (auto ch : sentence) {
+	size_t open = 0;
+	depth = 0;
+	for (char ch : text) {
+		instr_t instr{op_t::nop, 0, rule_of[static_cast<unsigned char>(ch)]};
 		switch (ch) {
-			case 'F':
-				builder.indices.push_back(static_cast<uint32_t>(builder.vertices.size()));
-				builder.vertices.push_back(state.pos);
-				state.pos += state.forward();
-				builder.indices.push_back(static_cast<uint32_t>(builder.vertices.size()));
-				builder.vertices.push_back(state.pos);
-				break;
-			case 'f':
-				state.pos += state.forward();
-				break;
-			case '+':
-				state.rot.x += angle;
-				break;
-			case '-':
-				state.rot.x -= angle;
-				break;
+			case 'F': instr.op = op_t::draw; break;
+			case 'f': instr.op = op_t::move; break;
+			case '+': instr.op = op_t::turn; instr.turn = 0; break;
+			case '-': instr.op = op_t::turn; instr.turn = 1; break;
+			case '&': instr.op = op_t::turn; instr.turn = 2; break;
+			case '^': instr.op = op_t::turn; instr.turn = 3; break;
+			case '<': instr.op = op_t::turn; instr.turn = 4; break;
+			case '>': instr.op = op_t::turn; instr.turn = 5; break;
 			case '[':
-				push();
+				instr.op = op_t::push;
+				depth = std::max(depth, ++open);
 				break;
 			case ']':
-				pop();
-				break;
-			case '&':
-				state.rot.y += angle;
-				break;
-			case '^':
-				state.rot.y -= angle;
-				break;
-			case '<':
-				state.rot.z += angle;
-				break;
-			case '>':
-				state.rot.z -= angle;
-				break;
-			default:
+				instr.op = op_t::pop;
+				open = open > 0 ? open - 1 : 0;
 				break;
+			default: break;
+		}
+
+		// symbols that neither move the turtle nor rewrite are dropped at compile time
+		if (instr.op != op_t::nop || instr.rule != 0) {
+			program.push_back(instr);
 		}
 	}
+	return program;
+}
+
+static constexpr uint32_t no_joint = std::numeric_limits<uint32_t>::max();
+static constexpr uint32_t entry_joint = no_joint - 1;
+
+struct turtle_state_t {
+	glm::vec3 pos;
+	glm::mat3 frame;
+	uint32_t joint; // vertex at pos that the next segment can start from
+};
+
+// One production expanded to a fixed depth, recorded from the identity turtle. Expanding the same
+// symbol to the same depth always draws the same shape up to the turtle's transform, so the
+// geometry is built once and every later occurrence is copied in transformed. Indices equal to
+// entry_joint stand for the joint the turtle arrives with.
+struct piece_t {
+	bool ready = false;
+	bool balanced = false; // never pops below its entry and leaves the stack as it found it
+	bool cached = false;
+	int net = 0;
+	int low = 0;
+	size_t segments = 0;
+
+	std::vector<glm::vec3> vertices{};
+	std::vector<uint32_t> indices{};
+
+	glm::vec3 end_pos{0, 0, 0};
+	glm::mat3 end_frame{1.0f};
+	uint32_t exit_joint = no_joint;
+};
+
+// largest piece that is kept as flat geometry
+static constexpr size_t piece_segments = 1 << 12;
+
+struct LTurtle {
+	std::vector<program_t> programs{};
+	std::array<glm::mat3, 6> turns{};
+
+	// one piece per (production, remaining depth)
+	std::vector<piece_t> pieces{};
+	size_t depths = 0;
+
+	std::vector<turtle_state_t> stack{};
+	turtle_state_t state{glm::vec3{0, 0, 0}, glm::mat3{1.0f}, no_joint};
+
+	piece_t& piece(uint16_t rule, size_t depth) {
+		auto& piece = pieces[(rule - 1) * depths + depth];
+		if (piece.ready) {
+			return piece;
+		}
+		piece.ready = true;
+
+		int running = 0;
+		for (auto const& instr : programs[rule]) {
+			if (instr.rule != 0 && depth > 0) {
+				auto const& sub = this->piece(instr.rule, depth - 1);
+				piece.low = std::min(piece.low, running + sub.low);
+				piece.segments += sub.segments;
+				running += sub.net;
+			} else if (instr.op == op_t::draw) {
+				piece.segments++;
+			} else if (instr.op == op_t::push) {
+				running++;
+			} else if (instr.op == op_t::pop) {
+				piece.low = std::min(piece.low, --running);
+			}
+		}
+		piece.net = running;
+		piece.balanced = piece.net == 0 && piece.low == 0;
+
+		// unbalanced pieces reach into the caller's stack and are always expanded in place; large
+		// ones are too, since copying them in would cost as much as expanding their cached parts
+		piece.cached = piece.balanced && piece.segments <= piece_segments;
+		if (piece.cached) {
+			auto saved = state;
+			state = {glm::vec3{0, 0, 0}, glm::mat3{1.0f}, entry_joint};
+			run(programs[rule], depth, piece.vertices, piece.indices);
+			piece.end_pos = state.pos;
+			piece.end_frame = state.frame;
+			piece.exit_joint = state.joint;
+			state = saved;
+		}
+		return piece;
+	}
+
+	void emit(const piece_t& piece, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices) {
+		auto base = static_cast<uint32_t>(vertices.size());
+		vertices.resize(base + piece.vertices.size());
+		glm::vec3* vertex_out = vertices.data() + base;
+		for (auto const& vertex : piece.vertices) {
+			*vertex_out++ = state.pos + state.frame * vertex;
+		}
+
+		size_t first = indices.size();
+		indices.resize(first + piece.indices.size());
+		uint32_t* index_out = indices.data() + first;
+
+		uint32_t entry = state.joint;
+		for (uint32_t index : piece.indices) {
+			if (index != entry_joint) {
+				*index_out++ = base + index;
+				continue;
+			}
+			if (entry == no_joint) {
+				entry = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(state.pos);
+			}
+			*index_out++ = entry;
+		}
+
+		if (piece.exit_joint == entry_joint) {
+			state.joint = entry;
+		} else if (piece.exit_joint == no_joint) {
+			state.joint = no_joint;
+		} else {
+			state.joint = base + piece.exit_joint;
+		}
+		state.pos += state.frame * piece.end_pos;
+		state.frame = state.frame * piece.end_frame;
+	}
+
+	void run(const program_t& program, size_t depth, std::vector<glm::vec3>& vertices, std::vector<uint32_t>& indices) {
+		for (auto const& instr : program) {
+			if (instr.rule != 0 && depth > 0) {
+				auto const& sub = piece(instr.rule, depth - 1);
+				if (sub.cached) {
+					emit(sub, vertices, indices);
+				} else {
+					run(programs[instr.rule], depth - 1, vertices, indices);
+				}
+				continue;
+			}
+
+			switch (instr.op) {
+				case op_t::draw:
+					// consecutive segments share their joint vertex
+					if (state.joint == no_joint) {
+						state.joint = static_cast<uint32_t>(vertices.size());
+						vertices.push_back(state.pos);
+					}
+					indices.push_back(state.joint);
+					state.pos += state.frame[1];
+					state.joint = static_cast<uint32_t>(vertices.size());
+					indices.push_back(state.joint);
+					vertices.push_back(state.pos);
+					break;
+				case op_t::move:
+					state.pos += state.frame[1];
+					state.joint = no_joint;
+					break;
+				case op_t::turn:
+					state.frame = state.frame * turns[instr.turn];
+					break;
+				case op_t::push:
+					stack.push_back(state);
+					break;
+				case op_t::pop:
+					if (!stack.empty()) {
+						state = stack.back();
+						stack.pop_back();
+					}
+					break;
+				default:
+					break;
+			}
+		}
+	}
+};
+
+//todo: generate solid mesh
+std::unique_ptr<GameObject> createLObject(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations, float angle) {
+	LTurtle turtle{};
+
+	// the axiom and every production are compiled once, so the expansion below never looks a
+	// symbol up in the rule map
+	std::array<uint16_t, 256> rule_of{};
+	uint16_t next_rule = 1;
+	for (auto const& rule : rules) {
+		rule_of[static_cast<unsigned char>(rule.first)] = next_rule++;
+	}
+
+	size_t rule_depth = 0;
+	turtle.programs.resize(rules.size() + 1);
+	for (auto const& rule : rules) {
+		size_t depth;
+		turtle.programs[rule_of[static_cast<unsigned char>(rule.first)]] = compile(rule.second, rule_of, depth);
+		rule_depth = std::max(rule_depth, depth);
+	}
+	size_t axiom_depth;
+	turtle.programs[0] = compile(axiom, rule_of, axiom_depth);
+
+	// rotations are applied in the turtle's local frame, whose y axis is the heading
+	turtle.turns = {
+		axisRotation(0, -angle), axisRotation(0, angle),
+		axisRotation(1, -angle), axisRotation(1, angle),
+		axisRotation(2, -angle), axisRotation(2, angle),
+	};
+
+	turtle.depths = iterations;
+	turtle.pieces.resize(rules.size() * iterations);
+	turtle.stack.reserve(axiom_depth + iterations * rule_depth);
+
+	// the sentence is never built: the axiom is interpreted with every rewritable symbol replaced by
+	// its memoized piece, so interpretation work grows with the number of distinct (symbol, depth)
+	// pairs and only the final copy grows with the output
+	MeshBuilder builder{};
+	turtle.run(turtle.programs[0], iterations, builder.vertices, builder.indices);
 
 	auto object = std::make_unique<GameObject>();
 	object->mesh = builder.build();
 	object->mesh.shader = Shader::find("default");
 	object->mesh.mode = GL_LINES;
 	return std::move(object);
-}
\ No newline at end of file
+}
+
+// symbols per task in a rewrite step
+static constexpr size_t rewrite_grain = 1 << 16;
+
+std::string expandLSystem(const std::string& axiom, const std::map<char, std::string>& rules, size_t iterations) {
+	// every byte maps to its production, symbols without a rule to themselves
+	std::array<std::string, 256> productions{};
+	for (size_t c = 0; c < productions.size(); c++) {
+		productions[c] = std::string(1, static_cast<char>(c));
+	}
+	for (auto const& rule : rules) {
+		productions[static_cast<unsigned char>(rule.first)] = rule.second;
+	}
+
+	std::array<size_t, 256> lengths{};
+	for (size_t c = 0; c < productions.size(); c++) {
+		lengths[c] = productions[c].size();
+	}
+
+	auto& pool = ThreadPool::instance();
+
+	std::string sentence = axiom;
+	std::string next_sentence{};
+	std::vector<size_t> offsets{};
+
+	while (iterations > 0) {
+		iterations--;
+
+		size_t chunks = (sentence.size() + rewrite_grain - 1) / rewrite_grain;
+		offsets.assign(chunks + 1, 0);
+
+		// output length of every chunk, then an exclusive scan over the chunks gives their offsets
+		pool.parallel_for(0, chunks, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				size_t last = std::min(sentence.size(), (c + 1) * rewrite_grain);
+				size_t length = 0;
+				for (size_t i = c * rewrite_grain; i < last; i++) {
+					length += lengths[static_cast<unsigned char>(sentence[i])];
+				}
+				offsets[c + 1] = length;
+			}
+		});
+		for (size_t c = 0; c < chunks; c++) {
+			offsets[c + 1] += offsets[c];
+		}
+
+		next_sentence.resize(offsets[chunks]);
+		pool.parallel_for(0, chunks, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				size_t last = std::min(sentence.size(), (c + 1) * rewrite_grain);
+				char* out = &next_sentence[0] + offsets[c];
+				for (size_t i = c * rewrite_grain; i < last; i++) {
+					auto const& production = productions[static_cast<unsigned char>(sentence[i])];
+					std::memcpy(out, production.data(), production.size());
+					out += production.size();
+				}
+			}
+		});
+
+		sentence.swap(next_sentence);
+	}
+	return sentence;
+}
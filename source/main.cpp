@@ -30,6 +30,7 @@ limitations under the License.
 #include "tree.h"
 #include "lsystem.h"
 #include "proctree.h"
+#include "forest.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -75,11 +76,15 @@ int main() {
 
 	Shader::preload("default", "assets/shaders/default/vertex.glsl", "assets/shaders/default/fragment.glsl");
 	Shader::preload("default_wood", "assets/shaders/default/vertex.glsl", "assets/shaders/default/fragment.glsl");
+	Shader::preload("instanced_wood", "assets/shaders/instanced/vertex.glsl", "assets/shaders/default/fragment.glsl");
+	Shader::preload("impostor", "assets/shaders/impostor/vertex.glsl", "assets/shaders/impostor/fragment.glsl");
+	Shader::preload("impostor_bake", "assets/shaders/default/vertex.glsl", "assets/shaders/impostor/bake.glsl");
 
 	objects.push_back(createPlanet({0, 0, 0}, 5, 30, 5));
 	auto planet = static_cast<Planet*>(objects.back().get());
 
 	std::vector<GameObject*> trees{};
+	TreeVariantPool forest{TreeProperties{}, 4};
 
 
 //	auto lookRotation = [up = glm::vec3{0, 1, 0}](const glm::vec3& point, const glm::vec3& direction) -> glm::vec3 {
@@ -97,15 +102,18 @@ int main() {
 			float z = planet->radius * std::cos(r_theta);
 
 			auto point = planet->getPoint({x, y, z});
-//			auto tree = createProcTree(glm::normalize(point) * 100.0f);
-//
-//			tree->transform.rotation = glm::vec3{0, 0, 0};
-//			trees.push_back(tree.get());
-//					lookRotation(planet->transform.position - point, point);
-//			objects.push_back(std::move(tree));
+
+			Transform transform{};
+			transform.position = glm::normalize(glm::vec3{x, y, z}) * 100.0f;
+			forest.place(transform);
 		}
 	}
 
+	for (auto& tree : forest.build()) {
+		trees.push_back(tree.get());
+		objects.push_back(std::move(tree));
+	}
+
 	Camera camera{};
 	camera.far = 100000.0f;
 	camera.transform.position = {100, 30, 0};
@@ -122,11 +130,16 @@ int main() {
 
 		for (auto const& obj : objects) {
 			auto model_matrix = obj->transform.matrix();
+			auto& mesh = obj->getMesh(camera);
+			if (!mesh.meshlets.empty()) {
+				auto camera_position = glm::inverse(model_matrix) * glm::vec4{camera.transform.position, 1.0f};
+				mesh.cull(world_matrix * model_matrix, glm::vec3{camera_position});
+			}
 
-			glUseProgram(obj->mesh.shader);
+			glUseProgram(mesh.shader);
 			glUniformMatrix4fv(0, 1, GL_FALSE, glm::value_ptr(world_matrix));
 			glUniformMatrix4fv(1, 1, GL_FALSE, glm::value_ptr(model_matrix));
-			obj->mesh.draw();
+			mesh.draw();
 		}
 
 		window.swap();
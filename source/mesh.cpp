@@ -14,9 +14,13 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include "mesh.h"
 
+#include <glm/geometric.hpp>
+
 Mesh::Mesh() {
 	glGenVertexArrays(1, &VAO);
 	glBindVertexArray(VAO);
@@ -48,8 +52,6 @@ Mesh::Mesh() {
 }
 
 void Mesh::setVertices(const std::vector<glm::vec3> &vertices) {
-	this->vertices = vertices;
-
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
@@ -57,8 +59,6 @@ void Mesh::setVertices(const std::vector<glm::vec3> &vertices) {
 }
 
 void Mesh::setColors(const std::vector<glm::vec3> &colors) {
-	this->colors = colors;
-
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, CBO);
 	glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(glm::vec3), colors.data(), GL_STATIC_DRAW);
@@ -66,8 +66,6 @@ void Mesh::setColors(const std::vector<glm::vec3> &colors) {
 }
 
 void Mesh::setNormals(const std::vector<glm::vec3> &normals) {
-	this->normals = normals;
-
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ARRAY_BUFFER, NBO);
 	glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
@@ -75,15 +73,160 @@ void Mesh::setNormals(const std::vector<glm::vec3> &normals) {
 }
 
 void Mesh::setIndices(const std::vector<uint32_t> &indices) {
-	this->indices = indices;
+	index_count = static_cast<GLsizei>(indices.size());
+
+	uint32_t max_index = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end());
 
 	glBindVertexArray(VAO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+	if (max_index <= UINT16_MAX) {
+		std::vector<uint16_t> short_indices(indices.begin(), indices.end());
+
+		index_type = GL_UNSIGNED_SHORT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, short_indices.size() * sizeof(uint16_t), short_indices.data(), GL_STATIC_DRAW);
+	} else {
+		index_type = GL_UNSIGNED_INT;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), indices.data(), GL_STATIC_DRAW);
+	}
 	glBindVertexArray(0);
 }
 
+void Mesh::setGeometry(const VertexFormat& format, std::shared_ptr<const Geometry> geometry) {
+	auto data = format.encode(geometry->vertices, geometry->colors, geometry->normals);
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+	format.bind();
+	glBindVertexArray(0);
+
+	setIndices(geometry->indices);
+	this->geometry = std::move(geometry);
+}
+
+void Mesh::dropGeometry() {
+	geometry.reset();
+}
+
+void Mesh::setVertices(const VertexFormat& format, const UploadRing& ring, const UploadAllocation& vertices) {
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, ring.buffer);
+	format.bind(static_cast<size_t>(vertices.offset));
+	glBindVertexArray(0);
+}
+
+// a mat4 attribute takes four consecutive locations, one per column
+static void pointInstances(GLuint buffer, GLintptr offset) {
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (GLuint i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(3 + i);
+		glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4x4), reinterpret_cast<void*>(offset + sizeof(glm::vec4) * i));
+		glVertexAttribDivisor(3 + i, 1);
+	}
+}
+
+void Mesh::setInstances(const std::vector<glm::mat4x4> &transforms) {
+	instances = static_cast<GLsizei>(transforms.size());
+	instanced = true;
+
+	glBindVertexArray(VAO);
+	if (!TBO) {
+		glGenBuffers(1, &TBO);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, TBO);
+	glBufferData(GL_ARRAY_BUFFER, transforms.size() * sizeof(glm::mat4x4), transforms.data(), GL_STATIC_DRAW);
+	pointInstances(TBO, 0);
+	glBindVertexArray(0);
+}
+
+void Mesh::setInstances(const UploadRing& ring, const UploadAllocation& transforms) {
+	instances = static_cast<GLsizei>(transforms.size / static_cast<GLsizeiptr>(sizeof(glm::mat4x4)));
+	instanced = true;
+
+	glBindVertexArray(VAO);
+	pointInstances(ring.buffer, transforms.offset);
+	glBindVertexArray(0);
+}
+
+void Mesh::setRanges(const std::vector<DrawRange>& ranges) {
+	counts.clear();
+	offsets.clear();
+	base_vertices.clear();
+
+	for (auto const& range : ranges) {
+		counts.push_back(range.count);
+		offsets.push_back(reinterpret_cast<const void*>(range.first_index * (index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t))));
+		base_vertices.push_back(range.base_vertex);
+	}
+}
+
+void Mesh::setMeshlets(std::vector<Meshlet> meshlets) {
+	this->meshlets = std::move(meshlets);
+	setRanges({DrawRange{0, index_count, 0}});
+}
+
+size_t Mesh::cull(const glm::mat4x4& model_view_projection, const glm::vec3& camera_position) {
+	// clip space planes pulled back through the matrix, facing inwards
+	std::array<glm::vec4, 6> planes{};
+	for (int i = 0; i < 3; i++) {
+		glm::vec4 row{model_view_projection[0][i], model_view_projection[1][i], model_view_projection[2][i], model_view_projection[3][i]};
+		glm::vec4 w{model_view_projection[0][3], model_view_projection[1][3], model_view_projection[2][3], model_view_projection[3][3]};
+		planes[i * 2] = w + row;
+		planes[i * 2 + 1] = w - row;
+	}
+	for (auto& plane : planes) {
+		plane /= glm::length(glm::vec3{plane});
+	}
+
+	counts.clear();
+	offsets.clear();
+	base_vertices.clear();
+
+	size_t index_size = index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	size_t visible = 0;
+	size_t end = 0;
+
+	for (auto const& meshlet : meshlets) {
+		bool inside = std::all_of(planes.begin(), planes.end(), [&](const glm::vec4& plane) {
+			return glm::dot(glm::vec3{plane}, meshlet.center) + plane.w >= -meshlet.radius;
+		});
+		if (!inside) {
+			continue;
+		}
+
+		// every point of the bounding sphere sees every triangle from behind
+		auto offset = meshlet.center - camera_position;
+		if (glm::dot(offset, meshlet.cone_axis) >= meshlet.cone_cutoff * glm::length(offset) + meshlet.radius * (1.0f + meshlet.cone_cutoff)) {
+			continue;
+		}
+
+		visible++;
+		if (!counts.empty() && end == meshlet.first_index) {
+			counts.back() += static_cast<GLsizei>(meshlet.count);
+		} else {
+			counts.push_back(static_cast<GLsizei>(meshlet.count));
+			offsets.push_back(reinterpret_cast<const void*>(meshlet.first_index * index_size));
+			base_vertices.push_back(0);
+		}
+		end = meshlet.first_index + meshlet.count;
+	}
+	return visible;
+}
+
 void Mesh::draw() {
 	glBindVertexArray(VAO);
-	glDrawElements(mode, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, nullptr);
+	if (texture) {
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+	if (!meshlets.empty() && counts.empty()) {
+		return;
+	}
+	if (!counts.empty()) {
+		glMultiDrawElementsBaseVertex(mode, counts.data(), index_type, offsets.data(), static_cast<GLsizei>(counts.size()), base_vertices.data());
+	} else if (instanced) {
+		glDrawElementsInstanced(mode, index_count, index_type, nullptr, instances);
+	} else {
+		glDrawElements(mode, index_count, index_type, nullptr);
+	}
 }
@@ -16,6 +16,7 @@ limitations under the License.
 
 #include "mesh_builder.h"
 #include "mesh.h"
+#include "mesh_optimizer.h"
 
 #include <glm/detail/func_geometric.inl>
 
@@ -27,11 +28,23 @@ void MeshBuilder::clear() {
 }
 
 Mesh MeshBuilder::build() {
+	std::vector<Meshlet> meshlets{};
+	if (meshlet_triangles > 0) {
+		meshlets = buildMeshlets(indices, vertices, meshlet_triangles);
+		optimizeVertexFetch(*this);
+	}
+
+	auto geometry = std::make_shared<const Geometry>(Geometry{std::move(vertices), std::move(colors), std::move(normals), std::move(indices)});
+	clear();
+
 	Mesh mesh;
-	mesh.setVertices(vertices);
-	mesh.setColors(colors);
-	mesh.setNormals(normals);
-	mesh.setIndices(indices);
+	mesh.setGeometry(format, std::move(geometry));
+	if (!meshlets.empty()) {
+		mesh.setMeshlets(std::move(meshlets));
+	}
+	if (!keep_geometry) {
+		mesh.dropGeometry();
+	}
 	return mesh;
 }
 
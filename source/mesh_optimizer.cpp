@@ -0,0 +1,650 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "mesh_optimizer.h"
+#include "spatial_grid.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+float analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count, size_t cache_size) {
+	if (indices.size() < 3) {
+		return 0;
+	}
+
+	// a vertex stays cached until cache_size more misses have pushed it out
+	std::vector<size_t> stamps(vertex_count, 0);
+	size_t misses = 0;
+
+	for (auto index : indices) {
+		if (stamps[index] <= misses) {
+			misses++;
+			stamps[index] = misses + cache_size;
+		}
+	}
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+static uint32_t hashFloats(const glm::vec3& value, uint32_t hash) {
+	uint32_t bits[3];
+	std::memcpy(bits, &value, sizeof(bits));
+	for (auto word : bits) {
+		hash ^= word;
+		hash *= 0x01000193u;
+		hash ^= hash >> 15;
+	}
+	return hash;
+}
+
+size_t weldVertices(MeshBuilder& builder) {
+	size_t count = builder.vertices.size();
+	bool has_colors = builder.colors.size() == count;
+	bool has_normals = builder.normals.size() == count;
+
+	auto equal = [&](uint32_t a, uint32_t b) {
+		return std::memcmp(&builder.vertices[a], &builder.vertices[b], sizeof(glm::vec3)) == 0 &&
+			(!has_colors || std::memcmp(&builder.colors[a], &builder.colors[b], sizeof(glm::vec3)) == 0) &&
+			(!has_normals || std::memcmp(&builder.normals[a], &builder.normals[b], sizeof(glm::vec3)) == 0);
+	};
+
+	// open addressing, at most half full
+	size_t capacity = 1;
+	while (capacity < count * 2) {
+		capacity <<= 1;
+	}
+	constexpr uint32_t empty = ~0u;
+	std::vector<uint32_t> table(capacity, empty);
+
+	std::vector<uint32_t> remap(count);
+	uint32_t unique = 0;
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t hash = hashFloats(builder.vertices[i], 0x811c9dc5u);
+		if (has_colors) {
+			hash = hashFloats(builder.colors[i], hash);
+		}
+		if (has_normals) {
+			hash = hashFloats(builder.normals[i], hash);
+		}
+
+		size_t slot = hash & (capacity - 1);
+		while (table[slot] != empty && !equal(table[slot], i)) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+
+		if (table[slot] == empty) {
+			table[slot] = i;
+
+			// survivors keep their relative order, so they can be compacted in place
+			builder.vertices[unique] = builder.vertices[i];
+			if (has_colors) {
+				builder.colors[unique] = builder.colors[i];
+			}
+			if (has_normals) {
+				builder.normals[unique] = builder.normals[i];
+			}
+			remap[i] = unique++;
+		} else {
+			remap[i] = remap[table[slot]];
+		}
+	}
+
+	for (auto& index : builder.indices) {
+		index = remap[index];
+	}
+
+	builder.vertices.resize(unique);
+	if (has_colors) {
+		builder.colors.resize(unique);
+	}
+	if (has_normals) {
+		builder.normals.resize(unique);
+	}
+	return unique;
+}
+
+// constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static constexpr size_t forsyth_cache_size = 32;
+static constexpr float forsyth_decay_power = 1.5f;
+static constexpr float forsyth_last_triangle_score = 0.75f;
+static constexpr float forsyth_valence_scale = 2.0f;
+static constexpr float forsyth_valence_power = 0.5f;
+static constexpr size_t forsyth_valence_table = 32;
+static constexpr uint32_t forsyth_max_candidates = 32;
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertex_count) {
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	std::array<float, forsyth_cache_size + 1> cache_scores{};
+	for (size_t i = 0; i < forsyth_cache_size; i++) {
+		if (i < 3) {
+			cache_scores[i] = forsyth_last_triangle_score;
+		} else {
+			float scale = 1.0f - static_cast<float>(i - 3) / static_cast<float>(forsyth_cache_size - 3);
+			cache_scores[i] = std::pow(scale, forsyth_decay_power);
+		}
+	}
+	// the last slot stands for vertices outside of the cache
+	cache_scores[forsyth_cache_size] = 0;
+
+	std::array<float, forsyth_valence_table> valence_scores{};
+	for (size_t i = 1; i < forsyth_valence_table; i++) {
+		valence_scores[i] = forsyth_valence_scale * std::pow(static_cast<float>(i), -forsyth_valence_power);
+	}
+
+	// triangles of every vertex, packed; the live ones are kept at the front of each vertex's run,
+	// and every corner remembers its slot so emitting a triangle is constant time
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (auto index : indices) {
+		offsets[index + 1]++;
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+	std::vector<uint32_t> live(vertex_count, 0);
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> slots(indices.size());
+	for (size_t corner = 0; corner < indices.size(); corner++) {
+		auto v = indices[corner];
+		slots[corner] = live[v];
+		adjacency[offsets[v] + live[v]++] = static_cast<uint32_t>(corner);
+	}
+
+	std::vector<uint32_t> positions(vertex_count, forsyth_cache_size);
+	std::vector<float> scores(vertex_count);
+
+	auto rescore = [&](uint32_t v) {
+		if (live[v] == 0) {
+			scores[v] = -1.0f;
+			return;
+		}
+		float valence = live[v] < forsyth_valence_table ? valence_scores[live[v]] : forsyth_valence_scale * std::pow(static_cast<float>(live[v]), -forsyth_valence_power);
+		scores[v] = cache_scores[positions[v]] + valence;
+	};
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		rescore(v);
+	}
+
+	std::vector<bool> emitted(triangle_count, false);
+	std::vector<uint32_t> result{};
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> cache{};
+	std::vector<uint32_t> next_cache{};
+	cache.reserve(forsyth_cache_size + 3);
+	next_cache.reserve(forsyth_cache_size + 3);
+
+	size_t cursor = 0;
+	int64_t best = 0;
+
+	while (true) {
+		if (best < 0) {
+			// dead end: no cached vertex has triangles left, continue in input order
+			while (cursor < triangle_count && emitted[cursor]) {
+				cursor++;
+			}
+			if (cursor == triangle_count) {
+				break;
+			}
+			best = static_cast<int64_t>(cursor);
+		}
+
+		auto triangle = static_cast<size_t>(best);
+		emitted[triangle] = true;
+
+		next_cache.clear();
+		for (size_t k = 0; k < 3; k++) {
+			size_t corner = triangle * 3 + k;
+			auto v = indices[corner];
+			result.push_back(v);
+			next_cache.push_back(v);
+
+			// swap the corner with the last live one of its vertex
+			uint32_t last = adjacency[offsets[v] + live[v] - 1];
+			adjacency[offsets[v] + slots[corner]] = last;
+			slots[last] = slots[corner];
+			live[v]--;
+		}
+		for (auto v : cache) {
+			if (v != next_cache[0] && v != next_cache[1] && v != next_cache[2]) {
+				next_cache.push_back(v);
+			}
+		}
+		cache.swap(next_cache);
+
+		// evicted vertices lose their cache score, the rest get the one of their new slot
+		for (size_t i = forsyth_cache_size; i < cache.size(); i++) {
+			positions[cache[i]] = forsyth_cache_size;
+			rescore(cache[i]);
+		}
+		cache.resize(std::min(cache.size(), forsyth_cache_size));
+		for (size_t i = 0; i < cache.size(); i++) {
+			positions[cache[i]] = static_cast<uint32_t>(i);
+			rescore(cache[i]);
+		}
+
+		// only the first few triangles of a vertex are candidates, which keeps fans around very
+		// high valence vertices from making this quadratic
+		best = -1;
+		float best_score = -1.0f;
+		for (auto v : cache) {
+			uint32_t candidates = std::min<uint32_t>(live[v], forsyth_max_candidates);
+			for (uint32_t j = 0; j < candidates; j++) {
+				auto t = adjacency[offsets[v] + j] / 3;
+				float score = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+	}
+
+	indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices, float threshold) {
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count == 0) {
+		return;
+	}
+
+	constexpr size_t cache_size = 16;
+	std::vector<size_t> stamps(vertices.size(), 0);
+	size_t misses = 0;
+
+	auto simulate = [&](size_t t) {
+		size_t triangle_misses = 0;
+		for (size_t k = 0; k < 3; k++) {
+			auto index = indices[t * 3 + k];
+			if (stamps[index] <= misses) {
+				misses++;
+				stamps[index] = misses + cache_size;
+				triangle_misses++;
+			}
+		}
+		return triangle_misses;
+	};
+
+	// hard boundaries are where a triangle misses the cache with all three vertices, so reordering
+	// there costs nothing
+	std::vector<size_t> hard{};
+	for (size_t t = 0; t < triangle_count; t++) {
+		if (simulate(t) == 3 || t == 0) {
+			hard.push_back(t);
+		}
+	}
+	hard.push_back(triangle_count);
+
+	// soft boundaries split a hard cluster again wherever restarting from a cold cache keeps its
+	// cache efficiency within threshold of the whole cluster
+	std::vector<size_t> clusters{};
+	for (size_t h = 0; h + 1 < hard.size(); h++) {
+		size_t begin = hard[h];
+		size_t end = hard[h + 1];
+
+		misses += cache_size;
+		size_t hard_misses = 0;
+		for (size_t t = begin; t < end; t++) {
+			hard_misses += simulate(t);
+		}
+		float limit = threshold * static_cast<float>(hard_misses) / static_cast<float>(end - begin);
+
+		misses += cache_size;
+		clusters.push_back(begin);
+		size_t cluster_misses = 0;
+		size_t cluster_start = begin;
+		for (size_t t = begin; t < end; t++) {
+			cluster_misses += simulate(t);
+			if (t + 1 < end && static_cast<float>(cluster_misses) <= limit * static_cast<float>(t + 1 - cluster_start)) {
+				clusters.push_back(t + 1);
+				cluster_start = t + 1;
+				cluster_misses = 0;
+				misses += cache_size;
+			}
+		}
+	}
+	clusters.push_back(triangle_count);
+
+	glm::vec3 center{0, 0, 0};
+	for (auto const& vertex : vertices) {
+		center += vertex;
+	}
+	center /= static_cast<float>(std::max<size_t>(vertices.size(), 1));
+
+	// area weighted centroid and normal of every cluster
+	std::vector<float> keys(clusters.size() - 1);
+	for (size_t c = 0; c + 1 < clusters.size(); c++) {
+		glm::vec3 centroid{0, 0, 0};
+		glm::vec3 normal{0, 0, 0};
+		float area = 0;
+
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			auto const& v0 = vertices[indices[t * 3]];
+			auto const& v1 = vertices[indices[t * 3 + 1]];
+			auto const& v2 = vertices[indices[t * 3 + 2]];
+
+			auto cross = glm::cross(v1 - v0, v2 - v0);
+			float weight = glm::length(cross);
+
+			centroid += (v0 + v1 + v2) * (weight / 3.0f);
+			normal += cross;
+			area += weight;
+		}
+
+		float length = glm::length(normal);
+		if (area > 0 && length > 0) {
+			keys[c] = glm::dot(centroid / area - center, normal / length);
+		}
+	}
+
+	std::vector<size_t> order(keys.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return keys[a] > keys[b];
+	});
+
+	std::vector<uint32_t> result{};
+	result.reserve(indices.size());
+	for (auto c : order) {
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices.swap(result);
+}
+
+void optimizeVertexFetch(MeshBuilder& builder) {
+	size_t count = builder.vertices.size();
+	bool has_colors = builder.colors.size() == count;
+	bool has_normals = builder.normals.size() == count;
+
+	constexpr uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(count, unused);
+	uint32_t next = 0;
+	for (auto& index : builder.indices) {
+		if (remap[index] == unused) {
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+
+	std::vector<glm::vec3> vertices(next);
+	std::vector<glm::vec3> colors(has_colors ? next : 0);
+	std::vector<glm::vec3> normals(has_normals ? next : 0);
+	for (size_t i = 0; i < count; i++) {
+		if (remap[i] == unused) {
+			continue;
+		}
+		vertices[remap[i]] = builder.vertices[i];
+		if (has_colors) {
+			colors[remap[i]] = builder.colors[i];
+		}
+		if (has_normals) {
+			normals[remap[i]] = builder.normals[i];
+		}
+	}
+
+	builder.vertices.swap(vertices);
+	if (has_colors) {
+		builder.colors.swap(colors);
+	}
+	if (has_normals) {
+		builder.normals.swap(normals);
+	}
+}
+
+static void boundMeshlet(Meshlet& meshlet, const std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices) {
+	auto begin = indices.begin() + meshlet.first_index;
+	auto end = begin + meshlet.count;
+
+	glm::vec3 min{vertices[*begin]};
+	glm::vec3 max{vertices[*begin]};
+	for (auto it = begin; it != end; ++it) {
+		min = glm::min(min, vertices[*it]);
+		max = glm::max(max, vertices[*it]);
+	}
+	meshlet.center = (min + max) * 0.5f;
+	meshlet.radius = 0;
+	for (auto it = begin; it != end; ++it) {
+		meshlet.radius = std::max(meshlet.radius, glm::distance(meshlet.center, vertices[*it]));
+	}
+
+	glm::vec3 normal{0, 0, 0};
+	for (auto it = begin; it != end; it += 3) {
+		normal += glm::cross(vertices[it[1]] - vertices[it[0]], vertices[it[2]] - vertices[it[0]]);
+	}
+	float length = glm::length(normal);
+	if (length == 0) {
+		meshlet.cone_cutoff = 1;
+		return;
+	}
+	meshlet.cone_axis = normal / length;
+
+	// degenerate triangles cover no pixels, whichever way they face
+	float min_dot = 1;
+	for (auto it = begin; it != end; it += 3) {
+		auto cross = glm::cross(vertices[it[1]] - vertices[it[0]], vertices[it[2]] - vertices[it[0]]);
+		float area = glm::length(cross);
+		if (area > 0) {
+			min_dot = std::min(min_dot, glm::dot(cross / area, meshlet.cone_axis));
+		}
+	}
+	meshlet.cone_cutoff = min_dot <= 0 ? 1.0f : std::sqrt(1.0f - min_dot * min_dot);
+}
+
+std::vector<Meshlet> buildMeshlets(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& vertices, size_t max_triangles) {
+	size_t triangle_count = indices.size() / 3;
+	std::vector<Meshlet> meshlets{};
+	if (triangle_count == 0 || max_triangles == 0) {
+		return meshlets;
+	}
+
+	std::vector<glm::vec3> centroids(triangle_count);
+	std::vector<glm::vec3> normals(triangle_count);
+	float total_area = 0;
+	for (size_t t = 0; t < triangle_count; t++) {
+		auto const& v0 = vertices[indices[t * 3]];
+		auto const& v1 = vertices[indices[t * 3 + 1]];
+		auto const& v2 = vertices[indices[t * 3 + 2]];
+
+		auto cross = glm::cross(v1 - v0, v2 - v0);
+		float length = glm::length(cross);
+
+		centroids[t] = (v0 + v1 + v2) / 3.0f;
+		normals[t] = length > 0 ? cross / length : glm::vec3{0, 0, 0};
+		total_area += length * 0.5f;
+	}
+
+	// triangles around every vertex
+	std::vector<uint32_t> offsets(vertices.size() + 1, 0);
+	for (auto index : indices) {
+		offsets[index + 1]++;
+	}
+	std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+	std::vector<uint32_t> adjacency(indices.size());
+	{
+		auto fill = offsets;
+		for (size_t i = 0; i < indices.size(); i++) {
+			adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+	}
+
+	// a full meshlet covers about this wide an area; islands too small to fill one, like leaf
+	// cards, are gathered from a grid of that size instead of each becoming its own meshlet
+	float cell_size = std::sqrt(total_area / static_cast<float>(triangle_count) * static_cast<float>(max_triangles));
+	SpatialGrid grid{cell_size > 0 ? cell_size : 1.0f};
+	for (size_t t = 0; t < triangle_count; t++) {
+		grid.insert(centroids[t], static_cast<uint32_t>(t));
+	}
+
+	constexpr uint32_t none = ~0u;
+	std::vector<uint32_t> owners(triangle_count, none);
+	std::vector<uint32_t> queued(triangle_count, none);
+	std::vector<uint32_t> candidates{};
+	std::vector<uint32_t> result{};
+	result.reserve(indices.size());
+
+	size_t seed = 0;
+	while (true) {
+		while (seed < triangle_count && owners[seed] != none) {
+			seed++;
+		}
+		if (seed == triangle_count) {
+			break;
+		}
+
+		auto id = static_cast<uint32_t>(meshlets.size());
+		Meshlet meshlet{};
+		meshlet.first_index = static_cast<uint32_t>(result.size());
+
+		glm::vec3 centroid_sum{0, 0, 0};
+		glm::vec3 normal_sum{0, 0, 0};
+		size_t count = 0;
+		candidates.clear();
+
+		auto add = [&](uint32_t t) {
+			owners[t] = id;
+			count++;
+			result.insert(result.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+			centroid_sum += centroids[t];
+			normal_sum += normals[t];
+
+			for (size_t k = 0; k < 3; k++) {
+				auto index = indices[t * 3 + k];
+				for (auto a = offsets[index]; a < offsets[index + 1]; a++) {
+					auto neighbour = adjacency[a];
+					if (owners[neighbour] == none && queued[neighbour] != id) {
+						queued[neighbour] = id;
+						candidates.push_back(neighbour);
+					}
+				}
+			}
+		};
+
+		add(static_cast<uint32_t>(seed));
+		while (count < max_triangles) {
+			auto center = centroid_sum / static_cast<float>(count);
+			float length = glm::length(normal_sum);
+			auto axis = length > 0 ? normal_sum / length : normal_sum;
+
+			// close by keeps the sphere tight, facing the same way the cone; the back of a leaf card is
+			// as close as it gets, so the two are added rather than multiplied
+			uint32_t best = none;
+			float best_score = std::numeric_limits<float>::max();
+			auto consider = [&](uint32_t t) {
+				float score = glm::distance(centroids[t], center) / grid.cell_size + 1.0f - glm::dot(normals[t], axis);
+				if (score < best_score) {
+					best_score = score;
+					best = t;
+				}
+			};
+
+			for (size_t i = 0; i < candidates.size();) {
+				if (owners[candidates[i]] != none) {
+					candidates[i] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				consider(candidates[i]);
+				i++;
+			}
+			// nothing connected is a good fit, as with the back of a card; look around the neighbourhood
+			if (best == none || best_score > 1.0f) {
+				grid.query(center, [&](uint32_t t) {
+					if (owners[t] == none) {
+						consider(t);
+					}
+				});
+			}
+			if (best == none) {
+				break;
+			}
+			add(best);
+		}
+
+		meshlet.count = static_cast<uint32_t>(count * 3);
+		meshlets.push_back(meshlet);
+	}
+
+	// cache order inside every meshlet, on indices local to it
+	std::vector<uint32_t> local(vertices.size(), none);
+	std::vector<uint32_t> globals{};
+	std::vector<uint32_t> local_indices{};
+	for (auto& meshlet : meshlets) {
+		globals.clear();
+		local_indices.clear();
+		for (uint32_t i = meshlet.first_index; i < meshlet.first_index + meshlet.count; i++) {
+			auto index = result[i];
+			if (local[index] == none) {
+				local[index] = static_cast<uint32_t>(globals.size());
+				globals.push_back(index);
+			}
+			local_indices.push_back(local[index]);
+		}
+
+		optimizeVertexCache(local_indices, globals.size());
+		for (size_t i = 0; i < local_indices.size(); i++) {
+			result[meshlet.first_index + i] = globals[local_indices[i]];
+		}
+		for (auto index : globals) {
+			local[index] = none;
+		}
+
+		boundMeshlet(meshlet, result, vertices);
+	}
+
+	glm::vec3 center{0, 0, 0};
+	for (auto const& vertex : vertices) {
+		center += vertex;
+	}
+	center /= static_cast<float>(std::max<size_t>(vertices.size(), 1));
+
+	std::stable_sort(meshlets.begin(), meshlets.end(), [&](const Meshlet& a, const Meshlet& b) {
+		return glm::dot(a.center - center, a.cone_axis) > glm::dot(b.center - center, b.cone_axis);
+	});
+
+	indices.clear();
+	for (auto& meshlet : meshlets) {
+		auto first = static_cast<uint32_t>(indices.size());
+		indices.insert(indices.end(), result.begin() + meshlet.first_index, result.begin() + meshlet.first_index + meshlet.count);
+		meshlet.first_index = first;
+	}
+	return meshlets;
+}
+
+MeshOptimization optimizeMesh(MeshBuilder& builder, bool overdraw) {
+	MeshOptimization result{};
+	result.vertices_before = builder.vertices.size();
+	result.acmr_before = analyzeVertexCache(builder.indices, builder.vertices.size());
+
+	weldVertices(builder);
+	optimizeVertexCache(builder.indices, builder.vertices.size());
+	if (overdraw) {
+		optimizeOverdraw(builder.indices, builder.vertices);
+	}
+	optimizeVertexFetch(builder);
+
+	result.vertices_after = builder.vertices.size();
+	result.acmr_after = analyzeVertexCache(builder.indices, builder.vertices.size());
+	return result;
+}
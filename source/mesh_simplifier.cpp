@@ -0,0 +1,413 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <glm/geometric.hpp>
+
+// open edges are held by a plane through the edge, perpendicular to its face, this much stronger
+// than the faces themselves
+static constexpr double border_weight = 10.0;
+
+// sum of squared distances to a set of area-weighted planes
+struct quadric_t {
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	void addPlane(const glm::vec3& normal, float distance, double w) {
+		double x = normal.x, y = normal.y, z = normal.z, d = distance;
+		a00 += w * x * x;
+		a01 += w * x * y;
+		a02 += w * x * z;
+		a11 += w * y * y;
+		a12 += w * y * z;
+		a22 += w * z * z;
+		b0 += w * x * d;
+		b1 += w * y * d;
+		b2 += w * z * d;
+		c += w * d * d;
+	}
+
+	void add(const quadric_t& other) {
+		a00 += other.a00;
+		a01 += other.a01;
+		a02 += other.a02;
+		a11 += other.a11;
+		a12 += other.a12;
+		a22 += other.a22;
+		b0 += other.b0;
+		b1 += other.b1;
+		b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	double evaluate(const glm::vec3& p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double result = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z) + 2 * (b0 * x + b1 * y + b2 * z) + c;
+		return std::max(result, 0.0);
+	}
+};
+
+enum VertexKind : uint8_t {
+	VERTEX_MANIFOLD,
+	VERTEX_BORDER, // on an open edge, may only slide along it
+	VERTEX_LOCKED
+};
+
+// one id per distinct position
+static std::vector<uint32_t> positionIds(const std::vector<glm::vec3>& vertices) {
+	size_t capacity = 1;
+	while (capacity < vertices.size() * 2) {
+		capacity <<= 1;
+	}
+	constexpr uint32_t empty = ~0u;
+	std::vector<uint32_t> table(capacity, empty);
+	std::vector<uint32_t> ids(vertices.size());
+
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		uint32_t bits[3];
+		std::memcpy(bits, &vertices[i], sizeof(bits));
+		uint32_t hash = (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+
+		size_t slot = hash & (capacity - 1);
+		while (table[slot] != empty && std::memcmp(&vertices[table[slot]], &vertices[i], sizeof(glm::vec3)) != 0) {
+			slot = (slot + 1) & (capacity - 1);
+		}
+		if (table[slot] == empty) {
+			table[slot] = i;
+		}
+		ids[i] = table[slot];
+	}
+	return ids;
+}
+
+float simplifyMesh(MeshBuilder& builder, const SimplifyOptions& options) {
+	auto& indices = builder.indices;
+	size_t vertex_count = builder.vertices.size();
+	size_t triangle_count = indices.size() / 3;
+	if (triangle_count <= options.target_triangles || vertex_count == 0) {
+		return 0;
+	}
+
+	bool has_colors = builder.colors.size() == vertex_count;
+	bool has_normals = builder.normals.size() == vertex_count;
+
+	// errors are measured in a copy scaled to the unit cube
+	glm::vec3 min = builder.vertices[0];
+	glm::vec3 max = builder.vertices[0];
+	for (auto const& vertex : builder.vertices) {
+		min = glm::min(min, vertex);
+		max = glm::max(max, vertex);
+	}
+	float extent = std::max(max.x - min.x, std::max(max.y - min.y, max.z - min.z));
+	float scale = extent > 0 ? 1.0f / extent : 1.0f;
+
+	std::vector<glm::vec3> points(vertex_count);
+	for (size_t i = 0; i < vertex_count; i++) {
+		points[i] = (builder.vertices[i] - min) * scale;
+	}
+
+	// edges are counted between positions, so attribute seams don't look like open edges
+	auto ids = positionIds(builder.vertices);
+	std::vector<uint32_t> shared(vertex_count, 0);
+	for (auto id : ids) {
+		shared[id]++;
+	}
+
+	std::unordered_map<uint64_t, uint32_t> edges{};
+	edges.reserve(indices.size());
+	auto edgeKey = [&](uint32_t a, uint32_t b) {
+		uint64_t pa = ids[a];
+		uint64_t pb = ids[b];
+		return pa < pb ? pa << 32 | pb : pb << 32 | pa;
+	};
+	for (size_t corner = 0; corner < indices.size(); corner++) {
+		size_t next = corner - corner % 3 + (corner + 1) % 3;
+		edges[edgeKey(indices[corner], indices[next])]++;
+	}
+
+	std::vector<uint8_t> kinds(vertex_count, VERTEX_MANIFOLD);
+	std::vector<quadric_t> quadrics(vertex_count);
+
+	for (size_t t = 0; t < triangle_count; t++) {
+		uint32_t v[3] = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+		auto normal = glm::cross(points[v[1]] - points[v[0]], points[v[2]] - points[v[0]]);
+		float length = glm::length(normal);
+		if (length == 0) {
+			continue;
+		}
+		normal /= length;
+
+		quadric_t face{};
+		face.addPlane(normal, -glm::dot(normal, points[v[0]]), length * 0.5);
+		face.weight = length * 0.5;
+
+		for (size_t k = 0; k < 3; k++) {
+			quadrics[v[k]].add(face);
+
+			uint32_t a = v[k];
+			uint32_t b = v[(k + 1) % 3];
+			uint32_t count = edges[edgeKey(a, b)];
+			if (count == 1) {
+				kinds[a] = std::max<uint8_t>(kinds[a], VERTEX_BORDER);
+				kinds[b] = std::max<uint8_t>(kinds[b], VERTEX_BORDER);
+
+				auto edge = points[b] - points[a];
+				auto side = glm::cross(edge, normal);
+				float side_length = glm::length(side);
+				if (side_length > 0) {
+					side /= side_length;
+
+					quadric_t border{};
+					border.addPlane(side, -glm::dot(side, points[a]), glm::dot(edge, edge) * border_weight);
+					quadrics[a].add(border);
+					quadrics[b].add(border);
+				}
+			} else if (count > 2) {
+				kinds[a] = VERTEX_LOCKED;
+				kinds[b] = VERTEX_LOCKED;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < vertex_count; i++) {
+		if (shared[ids[i]] > 1 || (options.lock_border && kinds[i] == VERTEX_BORDER)) {
+			kinds[i] = VERTEX_LOCKED;
+		}
+	}
+
+	// generators don't always normalise their normals, only the direction should count
+	std::vector<glm::vec3> normals{};
+	if (has_normals) {
+		normals.resize(vertex_count);
+		for (size_t i = 0; i < vertex_count; i++) {
+			float length = glm::length(builder.normals[i]);
+			normals[i] = length > 0 ? builder.normals[i] / length : builder.normals[i];
+		}
+	}
+
+	auto attributeCost = [&](uint32_t a, uint32_t b) {
+		float cost = 0;
+		if (has_colors) {
+			auto d = builder.colors[a] - builder.colors[b];
+			cost += options.color_weight * glm::dot(d, d);
+		}
+		if (has_normals) {
+			auto d = normals[a] - normals[b];
+			cost += options.normal_weight * glm::dot(d, d);
+		}
+		return cost;
+	};
+
+	struct collapse_t {
+		float cost;
+		uint32_t from;
+		uint32_t to;
+	};
+
+	float limit = options.target_error * options.target_error;
+	float reached = 0;
+
+	std::vector<uint32_t> offsets{};
+	std::vector<uint32_t> adjacency{};
+	std::vector<collapse_t> collapses{};
+	std::vector<bool> touched{};
+	std::vector<uint32_t> remap(vertex_count);
+
+	while (triangle_count > options.target_triangles) {
+		// triangles around every vertex
+		offsets.assign(vertex_count + 1, 0);
+		for (auto index : indices) {
+			offsets[index + 1]++;
+		}
+		std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+		adjacency.resize(indices.size());
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t corner = 0; corner < indices.size(); corner++) {
+				adjacency[fill[indices[corner]]++] = static_cast<uint32_t>(corner / 3);
+			}
+		}
+
+		auto openEdge = [&](uint32_t a, uint32_t b) {
+			uint32_t count = 0;
+			for (uint32_t j = offsets[a]; j < offsets[a + 1]; j++) {
+				auto t = adjacency[j];
+				count += indices[t * 3] == b || indices[t * 3 + 1] == b || indices[t * 3 + 2] == b;
+			}
+			return count == 1;
+		};
+
+		auto allowed = [&](uint32_t from, uint32_t to) {
+			if (kinds[from] == VERTEX_MANIFOLD) {
+				return true;
+			}
+			return kinds[from] == VERTEX_BORDER && kinds[to] == VERTEX_BORDER && openEdge(from, to);
+		};
+
+		auto cost = [&](uint32_t from, uint32_t to) {
+			double weight = std::max(quadrics[from].weight + quadrics[to].weight, 1e-12);
+			double error = (quadrics[from].evaluate(points[to]) + quadrics[to].evaluate(points[to])) / weight;
+			return static_cast<float>(error) + attributeCost(from, to);
+		};
+
+		collapses.clear();
+		for (size_t corner = 0; corner < indices.size(); corner++) {
+			uint32_t a = indices[corner];
+			uint32_t b = indices[corner - corner % 3 + (corner + 1) % 3];
+			if (a == b) {
+				continue;
+			}
+
+			bool forward = allowed(a, b);
+			bool backward = allowed(b, a);
+			if (forward && backward) {
+				float ab = cost(a, b);
+				float ba = cost(b, a);
+				collapses.push_back(ab <= ba ? collapse_t{ab, a, b} : collapse_t{ba, b, a});
+			} else if (forward) {
+				collapses.push_back({cost(a, b), a, b});
+			} else if (backward) {
+				collapses.push_back({cost(b, a), b, a});
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const collapse_t& x, const collapse_t& y) {
+			return x.cost < y.cost;
+		});
+
+		// a manifold collapse removes two triangles, so this takes about half the remaining excess
+		// per pass and leaves the rest to collapses that see the merged quadrics
+		size_t goal = std::max<size_t>((triangle_count - options.target_triangles) / 4, 1);
+		size_t applied = 0;
+
+		touched.assign(vertex_count, false);
+		std::iota(remap.begin(), remap.end(), 0);
+
+		for (auto const& collapse : collapses) {
+			if (applied >= goal || collapse.cost > limit) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			// moving from onto to must not fold any surviving triangle over
+			bool flips = false;
+			for (uint32_t j = offsets[collapse.from]; j < offsets[collapse.from + 1] && !flips; j++) {
+				auto t = adjacency[j];
+				uint32_t v[3] = {indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2]};
+				if (v[0] == collapse.to || v[1] == collapse.to || v[2] == collapse.to) {
+					continue;
+				}
+
+				auto before = glm::cross(points[v[1]] - points[v[0]], points[v[2]] - points[v[0]]);
+				for (auto& vertex : v) {
+					if (vertex == collapse.from) {
+						vertex = collapse.to;
+					}
+				}
+				auto after = glm::cross(points[v[1]] - points[v[0]], points[v[2]] - points[v[0]]);
+				flips = glm::dot(before, after) <= 0;
+			}
+			if (flips) {
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			reached = std::max(reached, collapse.cost);
+			applied++;
+
+			// the whole neighbourhood waits for the next pass, so every flip test above stays valid
+			for (uint32_t j = offsets[collapse.from]; j < offsets[collapse.from + 1]; j++) {
+				auto t = adjacency[j];
+				touched[indices[t * 3]] = true;
+				touched[indices[t * 3 + 1]] = true;
+				touched[indices[t * 3 + 2]] = true;
+			}
+		}
+
+		if (applied == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < triangle_count; t++) {
+			uint32_t a = remap[indices[t * 3]];
+			uint32_t b = remap[indices[t * 3 + 1]];
+			uint32_t c = remap[indices[t * 3 + 2]];
+			if (a == b || b == c || c == a) {
+				continue;
+			}
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+		triangle_count = write / 3;
+	}
+
+	return std::sqrt(reached);
+}
+
+std::vector<MeshBuilder> simplifyLodChain(const MeshBuilder& builder, size_t levels, float ratio, const SimplifyOptions& options) {
+	std::vector<MeshBuilder> chain{};
+	chain.reserve(levels);
+
+	const MeshBuilder* previous = &builder;
+	float target = static_cast<float>(builder.indices.size() / 3);
+
+	for (size_t i = 0; i < levels; i++) {
+		target *= ratio;
+
+		auto level_options = options;
+		level_options.target_triangles = std::max(options.target_triangles, static_cast<size_t>(target));
+
+		MeshBuilder level = *previous;
+		simplifyMesh(level, level_options);
+		if (level.indices.size() == previous->indices.size()) {
+			break;
+		}
+
+		optimizeVertexCache(level.indices, level.vertices.size());
+		optimizeVertexFetch(level);
+
+		chain.push_back(std::move(level));
+		previous = &chain.back();
+	}
+	return chain;
+}
+
+std::vector<std::vector<MeshBuilder>> simplifyLodChains(const std::vector<MeshBuilder>& builders, size_t levels, float ratio, const SimplifyOptions& options) {
+	std::vector<std::vector<MeshBuilder>> chains(builders.size());
+	ThreadPool::instance().parallel_for(0, builders.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			chains[i] = simplifyLodChain(builders[i], levels, ratio, options);
+		}
+	});
+	return chains;
+}
@@ -15,6 +15,8 @@ limitations under the License.
 */
 
 #include <glm/ext/quaternion_geometric.hpp>
+#include "mesh_builder.h"
+#include "mesh_optimizer.h"
 #include "perlin3d.h"
 #include "planet.h"
 
@@ -87,10 +89,14 @@ struct Triangle {
 glm::vec3 Planet::getPoint(const glm::vec3 &point) {
 	glm::vec3 out;
 
-	for (int i = 0; i < indices.size(); i += 3) {
-		auto v0 = vertices[i];
-		auto v1 = vertices[i + 1];
-		auto v2 = vertices[i + 2];
+	auto const& vertices = geometry->vertices;
+	auto const& indices = geometry->indices;
+
+	// vertices are welded and shared, so corners only come through the indices
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		auto v0 = vertices[indices[i]];
+		auto v1 = vertices[indices[i + 1]];
+		auto v2 = vertices[indices[i + 2]];
 
 
 	}
@@ -116,10 +122,11 @@ glm::vec3 Planet::getPoint(const glm::vec3 &point) {
 std::unique_ptr<GameObject> createPlanet(const glm::vec3& position, int level_of_detail, float radius, float height_variation) {
 	glm::vec3 dirt{0.35f, 0.3f, 0.3f};
 
-	std::vector<glm::vec3> vertices{};
-	std::vector<glm::vec3> colors{};
-	std::vector<glm::vec3> normals{};
-	std::vector<uint32_t> indices{};
+	MeshBuilder builder{};
+	auto& vertices = builder.vertices;
+	auto& colors = builder.colors;
+	auto& normals = builder.normals;
+	auto& indices = builder.indices;
 
 	glm::vec3 v[12] = {
 			glm::vec3{ 0.00000000000000000000000000000000, -1.00000000000000000000000000000000,  0.00000000000000000000000000000000},
@@ -141,8 +148,6 @@ std::unique_ptr<GameObject> createPlanet(const glm::vec3& position, int level_of
 		auto p1 = glm::normalize(v1);
 		auto p2 = glm::normalize(v2);
 
-		auto normal = glm::normalize(glm::cross((p1 - p0), (p2 - p0)));
-
 		auto baseIndex = static_cast<uint32_t>(vertices.size());
 
 		auto h0 = static_cast<float>(perlin3d::noise(p0, 8));
@@ -153,9 +158,10 @@ std::unique_ptr<GameObject> createPlanet(const glm::vec3& position, int level_of
 		vertices.push_back(p1 * (radius + h1 * height_variation));
 		vertices.push_back(p2 * (radius + h2 * height_variation));
 
-		normals.push_back(normal);
-		normals.push_back(normal);
-		normals.push_back(normal);
+		// radial normals, as the shader shades with; unlike face normals they let shared corners weld
+		normals.push_back(p0);
+		normals.push_back(p1);
+		normals.push_back(p2);
 
 		colors.push_back(dirt * (h0 * 0.6f + 0.4f));
 		colors.push_back(dirt * (h1 * 0.6f + 0.4f));
@@ -201,13 +207,13 @@ std::unique_ptr<GameObject> createPlanet(const glm::vec3& position, int level_of
 		subdivide(v[11], v[(i + 1) % 5 + 6], v[i + 6]);
 	}
 
-	Mesh mesh{};
-	mesh.setColors(colors);
-	mesh.setNormals(normals);
-	mesh.setIndices(indices);
-	mesh.setVertices(vertices);
+	optimizeMesh(builder);
+	builder.format = VertexFormat::compact();
+	builder.meshlet_triangles = 128;
 
-	auto object = std::make_unique<Planet>(vertices, indices, level_of_detail, radius, height_variation);
+	// the mesh and the planet's queries share one CPU copy
+	auto mesh = builder.build();
+	auto object = std::make_unique<Planet>(mesh.geometry, level_of_detail, radius, height_variation);
 	object->mesh = std::move(mesh);
 	object->mesh.shader = Shader::find("default");
 	object->transform.position = position;
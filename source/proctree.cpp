@@ -2,35 +2,102 @@
 #include <string.h>
 #include "proctree.h"
 #include "mesh_builder.h"
+#include "mesh_optimizer.h"
+#include "thread_pool.h"
+#include "random.h"
+#include "camera.h"
 
-#include <functional>
-
+#include <algorithm>
 #include <iostream>
 
+#include <glm/common.hpp>
+
+// subtrees with at least this many branches are generated as separate tasks
+static constexpr size_t task_size = 1024;
+
 struct Branch {
-	Branch *child_1 = nullptr;
-	Branch *child_2 = nullptr;
-	Branch *parent = nullptr;
+	int child_1 = -1;
+	int child_2 = -1;
+	int parent = -1;
+	int size = 1;
+	int level = 0;
 	glm::vec3 head{};
 	glm::vec3 tangent{};
 	float length = 1;
 	int trunktype = 0;
-	std::vector<int> ring_1;
-	std::vector<int> ring_2;
-	std::vector<int> ring_3;
-	std::vector<int> root_ring;
+	int rings = -1;
 	float radius = 0;
 	int last = 0;
+	uint32_t vertex = 0;
+	uint32_t index = 0;
 
 	Branch() = default;
-	Branch(glm::vec3 head, Branch *parent);
+	Branch(glm::vec3 head, int parent) : parent{parent}, head{head} {}
+};
+
+// Branches are stored in pre-order, so every subtree occupies a contiguous range of
+// branch.size entries and parents always come before their children. Rings are fixed-size
+// slices of one index pool, allocated only on emission: the root ring first, then ring_1, ring_2
+// and ring_3 of every fork.
+struct Skeleton {
+	std::vector<Branch> branches;
+	std::vector<int> rings;
+	int segments = 0;
+	bool parallel = false;
+	TaskGroup group{};
+
+	explicit Skeleton(const TreeProperties& properties);
+	Skeleton(const Skeleton& source, int cut, int segments);
+
+	Branch& operator[](int index) {
+		return branches[index];
+	}
 
-	~Branch();
+	int* root_ring() {
+		return rings.data();
+	}
+
+	int* ring_1(const Branch& branch) {
+		return rings.data() + branch.rings;
+	}
+
+	int* ring_2(const Branch& branch) {
+		return rings.data() + branch.rings + segments;
+	}
 
-	void split(int level, int aSteps, TreeProperties &properties, int aL1 = 1, int aL2 = 1);
+	int* ring_3(const Branch& branch) {
+		return rings.data() + branch.rings + segments * 2;
+	}
+
+	void split(int index, int fork, int level, int aSteps, const TreeProperties& properties);
+
+	// calls fn for every branch, always after its parent; large subtrees run as tasks
+	template<typename F>
+	void traverse(F&& fn) {
+		visit(0, fn);
+		ThreadPool::instance().wait(group);
+	}
+
+	template<typename F>
+	void visit(int index, F& fn) {
+		while (parallel && static_cast<size_t>(branches[index].size) >= task_size) {
+			fn(branches[index]);
+
+			int child_2 = branches[index].child_2;
+			ThreadPool::instance().submit(group, [this, child_2, &fn] { visit(child_2, fn); });
+			index = branches[index].child_1;
+		}
+
+		int end = index + branches[index].size;
+		for (int i = index; i < end; i++) {
+			fn(branches[i]);
+		}
+	}
+
+	static size_t count(int levels, int steps);
 };
 
-static glm::vec3 mirrorBranch(glm::vec3 a, glm::vec3 normal, TreeProperties &aProperties);
+static glm::vec3 mirrorBranch(glm::vec3 a, glm::vec3 normal, const TreeProperties& aProperties);
 static glm::vec3 scaleInDirection(glm::vec3 a, glm::vec3 b, float scale);
 
 static glm::vec3 scaleInDirection(glm::vec3 a, glm::vec3 b, float scale) {
@@ -45,33 +112,89 @@ static glm::vec3 vecAxisAngle(glm::vec3 a, glm::vec3 axis, float angle) {
 	return a * cosr + glm::cross(axis, a) * sinr + axis * dot(axis, a) * (1 - cosr);
 }
 
-static glm::vec3 mirrorBranch(glm::vec3 a, glm::vec3 normal, TreeProperties &properties) {
+static glm::vec3 mirrorBranch(glm::vec3 a, glm::vec3 normal, const TreeProperties& properties) {
 	glm::vec3 v = glm::cross(normal, glm::cross(a, normal));
 	return a - v * properties.branch_factor * glm::dot(v, a);
 }
 
-Branch::~Branch() {
-	delete child_1;
-	delete child_2;
+size_t Skeleton::count(int levels, int steps) {
+	if (levels <= 0) {
+		return 3;
+	}
+
+	// a side subtree split at (level, 0) has 2^(level + 2) - 1 branches, every trunk step adds 2^(level + 1)
+	return ((size_t(1) << (levels + 2)) - 1) + steps * (size_t(1) << (levels + 1));
+}
+
+// a fork splits its ring into three arcs and every pair of them forms a child's ring, which only
+// adds up for an even count; odd ones left a slot of ring_3 pointing at vertex 0
+static int evenSegments(int segments) {
+	return segments + (segments & 1);
 }
 
-Branch::Branch(glm::vec3 head, Branch *parent) : parent{parent}, head{head} {}
+Skeleton::Skeleton(const TreeProperties& properties) : segments{evenSegments(properties.segments)} {
+	size_t size = count(properties.levels, properties.tree_steps);
+
+	branches.resize(size);
+
+	parallel = ThreadPool::instance().size() > 1;
+}
+
+// copies the skeleton with every fork below the cut level turned into a leaf
+Skeleton::Skeleton(const Skeleton& source, int cut, int segments) : segments{evenSegments(segments)}, parallel{source.parallel} {
+	std::vector<int> remap(source.branches.size(), -1);
+	branches.reserve(source.branches.size());
+
+	int forks = 0;
+	for (size_t i = 0; i < source.branches.size();) {
+		auto const& branch = source.branches[i];
+		auto index = static_cast<int>(branches.size());
+		remap[i] = index;
+
+		branches.push_back(branch);
+		branches[index].child_1 = -1;
+		branches[index].child_2 = -1;
+		branches[index].radius = 0;
+
+		if (branch.parent != -1) {
+			branches[index].parent = remap[branch.parent];
+
+			auto& parent = branches[remap[branch.parent]];
+			(parent.child_1 == -1 ? parent.child_1 : parent.child_2) = index;
+		}
+
+		if (branch.child_1 == -1 || branch.level < cut) {
+			branches[index].size = 1;
+			i += branch.size;
+		} else {
+			branches[index].rings = this->segments + forks++ * 3 * this->segments;
+			i++;
+		}
+	}
+
+	for (auto i = static_cast<int>(branches.size()) - 1; i >= 0; i--) {
+		auto& branch = branches[i];
+		if (branch.child_1 != -1) {
+			branch.size = 1 + branches[branch.child_1].size + branches[branch.child_2].size;
+		}
+	}
+}
 
-void Branch::split(int level, int aSteps, TreeProperties &properties, int aL1, int aL2) {
+void Skeleton::split(int index, int fork, int level, int aSteps, const TreeProperties& properties) {
 	int rLevel = properties.levels - level;
 	glm::vec3 po{};
-	if (parent) {
-		po = parent->head;
+	if (branches[index].parent != -1) {
+		po = branches[branches[index].parent].head;
 	} else {
-		trunktype = 1;
+		branches[index].trunktype = 1;
 	}
-	glm::vec3 so = head;
+	glm::vec3 so = branches[index].head;
 	glm::vec3 dir = glm::normalize(so - po);
 
 	glm::vec3 normal = glm::cross(dir, {dir.z, dir.x, dir.y});
 	glm::vec3 tangent = glm::cross(dir, normal);
-	float r = properties.next(rLevel * 10 + aL1 * 5.0f + aL2 + properties.seed);
-	//float r2 = am_properties.random(rLevel * 10 + aL1 * 5.0f + aL2 + 1 + am_properties.seed); // never used
+	// a branch's slot in the pre-order array is fixed by the tree shape, not by the split order
+	float r = Random{static_cast<uint64_t>(properties.seed)}.value(static_cast<uint64_t>(index));
 
 	glm::vec3 adj = normal * r + tangent * (1 - r);
 	if (r > 0.5) adj = -adj;
@@ -97,342 +220,495 @@ void Branch::split(int level, int aSteps, TreeProperties &properties, int aL1, i
 	newdir = glm::normalize(newdir + a);
 	newdir2 = glm::normalize(newdir2 +  a);
 
-	glm::vec3 head0 = so + newdir * length;
-	glm::vec3 head1 = so + newdir2 * length;
-	child_1 = new Branch(head0, this);
-	child_2 = new Branch(head1, this);
-	child_1->length = std::pow(length, properties.length_falloff_power) * properties.length_falloff_factor;
-	child_2->length = std::pow(length, properties.length_falloff_power) * properties.length_falloff_factor;
+	float length = branches[index].length;
+	float child_length = std::pow(length, properties.length_falloff_power) * properties.length_falloff_factor;
 
+	size_t size_1 = 1;
 	if (level > 0) {
-		if (aSteps > 0) {
-			child_1->head = head + glm::vec3{(r - 0.5f) * 2 * properties.trunk_kink, properties.climb_rate, (r - 0.5f) * 2 * properties.trunk_kink};
-			child_1->trunktype = 1;
-			child_1->length = length * properties.taper_rate;
-			child_1->split(level, aSteps - 1, properties, aL1 + 1, aL2);
-		} else {
-			child_1->split(level - 1, 0, properties, aL1 + 1, aL2);
-		}
-		child_2->split(level - 1, 0, properties, aL1, aL2 + 1);
+		size_1 = aSteps > 0 ? count(level, aSteps - 1) : count(level - 1, 0);
 	}
-}
 
-std::unique_ptr<GameObject> createProcTree(const glm::vec3& position, const std::optional<TreeProperties>& properties) {
-	auto m_properties = properties.value_or(TreeProperties{});
+	int child_1 = index + 1;
+	int child_2 = index + 1 + static_cast<int>(size_1);
 
-	auto root = std::make_unique<Branch>(glm::vec3{0, m_properties.trunk_length, 0}, nullptr);
-	m_properties.rseed = m_properties.seed;
-	root->length = m_properties.initial_branch_length;
-	root->split(m_properties.levels, m_properties.tree_steps, m_properties);
+	branches[index].size = static_cast<int>(count(level, aSteps));
+	branches[index].level = level;
+	branches[index].rings = segments + fork * 3 * segments;
+	branches[index].child_1 = child_1;
+	branches[index].child_2 = child_2;
 
-	size_t vertices_count = 0;
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> colors;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::ivec3> faces;
+	branches[child_1] = Branch{so + newdir * length, index};
+	branches[child_1].length = child_length;
+	branches[child_2] = Branch{so + newdir2 * length, index};
+	branches[child_2].length = child_length;
 
-	std::function<void(Branch *)> calcVertSizes;
-	calcVertSizes = [&](Branch *branch) {
-		int segments = m_properties.segments;
+	if (level <= 0) {
+		return;
+	}
 
-		if (!branch->parent) {
-			vertices_count += segments;
+	auto descend = [&](int child, int child_fork, int child_level, int child_steps) {
+		if (parallel && count(child_level, child_steps) >= task_size) {
+			ThreadPool::instance().submit(group, [=, &properties] {
+				split(child, child_fork, child_level, child_steps, properties);
+			});
+		} else {
+			split(child, child_fork, child_level, child_steps, properties);
 		}
+	};
 
-		if (branch->child_1) {
-			vertices_count += 1 + (segments / 2) - 1 + 1 + (segments / 2) - 1 + (segments / 2) - 1;
+	if (aSteps > 0) {
+		branches[child_1].head = so + glm::vec3{(r - 0.5f) * 2 * properties.trunk_kink, properties.climb_rate, (r - 0.5f) * 2 * properties.trunk_kink};
+		branches[child_1].trunktype = 1;
+		branches[child_1].length = length * properties.taper_rate;
+		descend(child_1, fork + 1, level, aSteps - 1);
+	} else {
+		descend(child_1, fork + 1, level - 1, 0);
+	}
+	descend(child_2, fork + 1 + static_cast<int>(size_1 - 1) / 2, level - 1, 0);
+}
 
-			calcVertSizes(branch->child_1);
-			calcVertSizes(branch->child_2);
-		} else {
-			vertices_count++;
-//			vertices_count += 8;
-//			faces_count += 4;
+// sin and cos of every ring step. Ring axes are always perpendicular to the branch tangent, so
+// rotating the tangent about an axis reduces to the orthonormal frame (tangent, axis x tangent)
+// and every ring point is one multiply-add per table entry
+struct RingTable {
+	std::vector<float> cos;
+	std::vector<float> sin;
+
+	explicit RingTable(int segments) : cos(segments), sin(segments) {
+		auto step = static_cast<float>(M_PI * 2 / (float) segments);
+		for (int i = 0; i < segments; i++) {
+			cos[i] = std::cos(step * i);
+			sin[i] = std::sin(step * i);
 		}
-	};
+	}
 
-	std::function<void(Branch *)> createTriangles;
-	createTriangles = [&](Branch *branch) {
-		int segments = m_properties.segments;
+	// writes center + u * cos + v * sin for the steps [begin, end)
+	void arc(glm::vec3* out, int begin, int end, const glm::vec3& center, const glm::vec3& u, const glm::vec3& v) const {
+		const float* c = cos.data();
+		const float* s = sin.data();
+		for (int i = begin; i < end; i++) {
+			out[i - begin] = glm::vec3{
+				center.x + u.x * c[i] + v.x * s[i],
+				center.y + u.y * c[i] + v.y * s[i],
+				center.z + u.z * c[i] + v.z * s[i]
+			};
+		}
+	}
+};
 
-		if (!branch->parent) {
-			auto tangent = glm::normalize(glm::cross(branch->child_1->head - branch->head, branch->child_2->head - branch->head));
-			glm::vec3 left{-1, 0, 0};
+// settles the branch radius and passes it on to the children; returns the radius its rings use
+static float taper(Skeleton& skeleton, Branch& branch, const TreeProperties& properties) {
+	if (branch.radius == 0) {
+		branch.radius = properties.max_radius;
+	}
 
-			float angle = std::acos(glm::dot(tangent, left));
-			if (glm::dot(glm::cross(left, tangent), glm::normalize(branch->head)) > 0) {
-				angle = static_cast<float>(2 * M_PI - angle);
-			}
-			int segOffset = (int) floor(0.5f + (angle / M_PI / 2 * segments));
-			for (int i = 0; i < segments; i++) {
-				int v1 = branch->ring_1[i];
-				int v2 = branch->root_ring[(i + segOffset + 1) % segments];
-				int v3 = branch->root_ring[(i + segOffset) % segments];
-				int v4 = branch->ring_1[(i + 1) % segments];
+	float radius = std::min(branch.radius, branch.length);
 
-				faces.emplace_back(v1, v4, v3);
-				faces.emplace_back(v4, v2, v3);
-			}
+	if (branch.child_1 != -1) {
+		auto& child_1 = skeleton[branch.child_1];
+		child_1.radius = radius * (child_1.trunktype ? properties.taper_rate : properties.radius_falloff_rate);
+		skeleton[branch.child_2].radius = radius * properties.radius_falloff_rate;
+	}
+	return radius;
+}
+
+static void emit(Skeleton& skeleton, const TreeProperties& m_properties, MeshBuilder& builder) {
+	int segments = skeleton.segments;
+	RingTable table{segments};
+
+	// a pre-order prefix pass gives every branch its own vertex and index range,
+	// so the passes below can fill the final buffers from any number of tasks
+	auto vertices_count = static_cast<uint32_t>(segments);
+	uint32_t indices_count = 0;
+
+	for (auto& branch : skeleton.branches) {
+		if (branch.child_1 != -1) {
+			branch.vertex = vertices_count;
+			branch.index = indices_count;
+			vertices_count += segments + segments / 2 - 1;
+			indices_count += branch.parent == -1 ? segments * 6 : 0;
+			indices_count += skeleton[branch.child_1].child_1 != -1 ? segments * 6 : segments * 3;
+			indices_count += skeleton[branch.child_2].child_1 != -1 ? segments * 6 : segments * 3;
+		} else {
+			branch.last = static_cast<int>(vertices_count++);
 		}
+	}
 
-		if (!branch->child_1->ring_1.empty()) {
-			int segOffset0 = -1, segOffset1 = -1;
-			float match0 = 0, match1 = 0;
+	uint32_t total_vertices_count = vertices_count;
+	uint32_t total_indices_count = indices_count;
 
-			auto v1 = glm::normalize(vertices[branch->ring_2[0]] - branch->head);
-			auto v2 = glm::normalize(vertices[branch->ring_3[0]] - branch->head);
+	for (auto& branch : skeleton.branches) {
+		if (branch.child_1 == -1) {
+			branch.vertex = total_vertices_count;
+			branch.index = total_indices_count;
+			total_vertices_count += 8;
+			total_indices_count += 12;
+		}
+	}
 
-			v1 = scaleInDirection(v1, glm::normalize(branch->child_1->head - branch->head), 0);
-			v2 = scaleInDirection(v2, glm::normalize(branch->child_2->head - branch->head), 0);
+	// a full binary skeleton has (size - 1) / 2 forks with three rings each
+	skeleton.rings.resize((skeleton.branches.size() - 1) / 2 * 3 * segments + segments);
 
-			for (int i = 0; i < segments; i++) {
-				float l = glm::dot(glm::normalize(vertices[branch->child_1->ring_1[i]] - branch->child_1->head), v1);
-				if (segOffset0 == -1 || l > match0) {
-					match0 = l;
-					segOffset0 = segments - i;
-				}
-				l = glm::dot(glm::normalize(vertices[branch->child_2->ring_1[i]] - branch->child_2->head), v2);
-				if (segOffset1 == -1 || l > match1) {
-					match1 = l;
-					segOffset1 = segments - i;
-				}
-			}
+	builder.vertices.resize(total_vertices_count);
+	builder.colors.resize(total_vertices_count);
+	builder.normals.resize(total_vertices_count);
+	builder.indices.resize(total_indices_count);
 
-			for (int i = 0; i < segments; i++) {
-				int i1 = branch->child_1->ring_1[i];
-				int i2 = branch->ring_2[(i + segOffset0 + 1) % segments];
-				int i3 = branch->ring_2[(i + segOffset0) % segments];
-				int i4 = branch->child_1->ring_1[(i + 1) % segments];
+	auto& vertices = builder.vertices;
+	auto& normals = builder.normals;
+	auto& indices = builder.indices;
 
-				faces.emplace_back(i1, i4, i3);
-				faces.emplace_back(i4, i2, i3);
+	// a parent always passes its radius down before its children are visited
+	skeleton.traverse([&](Branch& branch) {
+		uint32_t vertex = branch.vertex;
+		float radius = taper(skeleton, branch, m_properties);
 
-				i1 = branch->child_2->ring_1[i];
-				i2 = branch->ring_3[(i + segOffset1 + 1) % segments];
-				i3 = branch->ring_3[(i + segOffset1) % segments];
-				i4 = branch->child_2->ring_1[(i + 1) % segments];
+		if (branch.parent == -1) {
+			glm::vec3 axis = {0, 1, 0};
+			glm::vec3 left = {-1, 0, 0};
 
-				faces.emplace_back(i1, i2, i3);
-				faces.emplace_back(i1, i4, i2);
-			}
+			float r_radius = radius / m_properties.radius_falloff_rate;
 
-			createTriangles(branch->child_1);
-			createTriangles(branch->child_2);
-		} else {
 			for (int i = 0; i < segments; i++) {
-				faces.emplace_back(branch->child_1->last, branch->ring_2[(i + 1) % segments], branch->ring_2[i]);
-				faces.emplace_back(branch->child_2->last, branch->ring_3[(i + 1) % segments], branch->ring_3[i]);
+				skeleton.root_ring()[i] = i;
 			}
+			table.arc(vertices.data(), 0, segments, {0, 0, 0}, left * r_radius, -glm::cross(axis, left) * r_radius);
 		}
-	};
 
-	std::function<void(Branch*, float)> createForks;
-	createForks = [&](Branch *branch, float radius) {
-		if (radius == 0) {
-			radius = m_properties.max_radius;
+		if (branch.child_1 == -1) {
+			vertices[branch.last] = branch.head;
+			return;
 		}
 
-		branch->radius = radius;
+		auto& child_1 = skeleton[branch.child_1];
+		auto& child_2 = skeleton[branch.child_2];
 
-		if (radius > branch->length) {
-			radius = branch->length;
+		glm::vec3 axis;
+		if (branch.parent != -1) {
+			axis = glm::normalize(branch.head - skeleton[branch.parent].head);
+		} else {
+			axis = glm::normalize(branch.head);
 		}
 
-		int segments = m_properties.segments;
+		auto axis1 = glm::normalize(branch.head - child_1.head);
+		auto axis2 = glm::normalize(branch.head - child_2.head);
+		auto tangent = glm::normalize(glm::cross(axis1, axis2));
+		branch.tangent = tangent;
 
-		auto segmentAngle = static_cast<float>(M_PI * 2 / (float) segments);
+		auto axis3 = glm::normalize(glm::cross(tangent, glm::normalize(-axis1 - axis2)));
+		glm::vec3 dir{axis2.x, 0, axis2.z};
 
-		if (!branch->parent) {
-			branch->root_ring.resize(static_cast<size_t>(segments));
+		auto centerloc = branch.head - dir * m_properties.max_radius * 0.5f;
 
-			glm::vec3 axis = {0, 1, 0};
-			glm::vec3 left = {-1, 0, 0};
+		int* ring_1 = skeleton.ring_1(branch);
+		int* ring_2 = skeleton.ring_2(branch);
+		int* ring_3 = skeleton.ring_3(branch);
 
-			float r_radius = radius / m_properties.radius_falloff_rate;
+		int ring0count = 0;
+		int ring1count = 0;
+		int ring2count = 0;
 
-			for (int i = 0; i < segments; i++) {
-				branch->root_ring[i] = static_cast<int>(vertices_count);
-				vertices[vertices_count++] = vecAxisAngle(left, axis, -segmentAngle * i) * r_radius;
-			}
+		float scale = m_properties.radius_falloff_rate;
+
+		if (child_1.trunktype || branch.trunktype) {
+			scale = 1.0f / m_properties.taper_rate;
 		}
 
-		if (branch->child_1) {
-			glm::vec3 axis;
-			if (branch->parent) {
-				axis = glm::normalize(branch->head - branch->parent->head);
-			} else {
-				axis = glm::normalize(branch->head);
-			}
+		//main segment ring
+		int linch0 = static_cast<int>(vertex);
+		ring_1[ring0count++] = linch0;
+		ring_3[ring2count++] = linch0;
+		vertices[vertex++] = centerloc + tangent * radius * scale;
+
+		int start = static_cast<int>(vertex - 1);
+		glm::vec3 d1 = vecAxisAngle(tangent, axis2, 1.57f);
+		glm::vec3 d2 = normalize(cross(tangent, axis));
+		float s = 1 / dot(d1, d2);
+		float size = radius * scale;
+
+		// the half ring is flattened along d2; scaling is linear, so it applies to the frame instead
+		table.arc(vertices.data() + vertex, 1, segments / 2, centerloc, scaleInDirection(tangent, d2, s) * size, scaleInDirection(glm::cross(axis2, tangent), d2, s) * size);
+		for (int i = 1; i < segments / 2; i++) {
+			ring_1[ring0count++] = start + i;
+			ring_3[ring2count++] = start + i;
+			vertex++;
+		}
+		int linch1 = static_cast<int>(vertex);
+		ring_1[ring0count++] = linch1;
+		ring_2[ring1count++] = linch1;
+		vertices[vertex++] = centerloc - tangent * radius * scale;
+		table.arc(vertices.data() + vertex, segments / 2 + 1, segments, centerloc, tangent * size, glm::cross(axis1, tangent) * size);
+		for (int i = segments / 2 + 1; i < segments; i++) {
+			ring_1[ring0count++] = static_cast<int>(vertex);
+			ring_2[ring1count++] = static_cast<int>(vertex);
+			vertex++;
+		}
+		ring_2[ring1count++] = linch0;
+		ring_3[ring2count++] = linch1;
+		start = static_cast<int>(vertex - 1);
+		table.arc(vertices.data() + vertex, 1, segments / 2, centerloc, tangent * size, glm::cross(axis3, tangent) * size);
+		for (int i = 1; i < segments / 2; i++) {
+			ring_2[ring1count++] = start + i;
+			ring_3[ring2count++] = start + (segments / 2 - i);
+		}
+	});
+
+	// normals are accumulated face by face; a parent's faces are the only ones shared with its
+	// children's vertices and always come first, so every sum sees the same order as a serial run
+	skeleton.traverse([&](Branch& branch) {
+		uint32_t index = branch.index;
+
+		auto face = [&](int i1, int i2, int i3) {
+			auto normal = glm::normalize(glm::cross(vertices[i2] - vertices[i1], vertices[i3] - vertices[i1]));
 
-			auto axis1 = glm::normalize(branch->head - branch->child_1->head);
-			auto axis2 = glm::normalize(branch->head - branch->child_2->head);
-			auto tangent = glm::normalize(glm::cross(axis1, axis2));
-			branch->tangent = tangent;
+			normals[i1] += normal;
+			normals[i2] += normal;
+			normals[i3] += normal;
 
-			auto axis3 = glm::normalize(glm::cross(tangent, glm::normalize(-axis1 - axis2)));
-			glm::vec3 dir{axis2.x, 0, axis2.z};
+			indices[index++] = static_cast<uint32_t>(i1);
+			indices[index++] = static_cast<uint32_t>(i2);
+			indices[index++] = static_cast<uint32_t>(i3);
+		};
+
+		if (branch.child_1 == -1) {
+			auto const& parent = skeleton[branch.parent];
+			glm::vec3 tangent = glm::normalize(glm::cross(skeleton[parent.child_1].head - parent.head, skeleton[parent.child_2].head - parent.head));
+			glm::vec3 binormal = glm::normalize(branch.head - parent.head);
+			//glm::vec3 normal = cross(tangent, binormal); //never used
 
-			auto centerloc = branch->head - dir * m_properties.max_radius * 0.5f;
+			uint32_t vertex = branch.vertex;
+
+			auto vert1 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head + tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch.length);
+			auto vert2 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head - tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch.length);
+			auto vert3 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head - tangent * m_properties.twig_scale - binormal * branch.length;
+			auto vert4 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head + tangent * m_properties.twig_scale - binormal * branch.length;
+
+			auto vert8 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head + tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch.length);
+			auto vert7 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head - tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch.length);
+			auto vert6 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head - tangent * m_properties.twig_scale - binormal * branch.length;
+			auto vert5 = static_cast<int>(vertex);
+			vertices[vertex++] = branch.head + tangent * m_properties.twig_scale - binormal * branch.length;
+
+			face(vert1, vert2, vert3);
+			face(vert4, vert1, vert3);
+			face(vert6, vert7, vert8);
+			face(vert6, vert8, vert5);
+			return;
+		}
 
-			branch->ring_1.resize(static_cast<size_t>(segments));
-			branch->ring_2.resize(static_cast<size_t>(segments));
-			branch->ring_3.resize(static_cast<size_t>(segments));
+		auto const& child_1 = skeleton[branch.child_1];
+		auto const& child_2 = skeleton[branch.child_2];
 
-			int ring0count = 0;
-			int ring1count = 0;
-			int ring2count = 0;
+		if (branch.parent == -1) {
+			auto tangent = glm::normalize(glm::cross(child_1.head - branch.head, child_2.head - branch.head));
+			glm::vec3 left{-1, 0, 0};
 
-			float scale = m_properties.radius_falloff_rate;
+			float angle = std::acos(glm::dot(tangent, left));
+			if (glm::dot(glm::cross(left, tangent), glm::normalize(branch.head)) > 0) {
+				angle = static_cast<float>(2 * M_PI - angle);
+			}
+			int segOffset = (int) floor(0.5f + (angle / M_PI / 2 * segments));
+			for (int i = 0; i < segments; i++) {
+				int v1 = skeleton.ring_1(branch)[i];
+				int v2 = skeleton.root_ring()[(i + segOffset + 1) % segments];
+				int v3 = skeleton.root_ring()[(i + segOffset) % segments];
+				int v4 = skeleton.ring_1(branch)[(i + 1) % segments];
 
-			if (branch->child_1->trunktype || branch->trunktype) {
-				scale = 1.0f / m_properties.taper_rate;
+				face(v1, v4, v3);
+				face(v4, v2, v3);
 			}
+		}
+
+		// a pruned skeleton may end one child in a twig while the other keeps forking
+		bool fork0 = child_1.child_1 != -1;
+		bool fork1 = child_2.child_1 != -1;
+
+		int segOffset0 = -1, segOffset1 = -1;
+		float match0 = 0, match1 = 0;
 
-			//main segment ring
-			int linch0 = static_cast<int>(vertices_count);
-			branch->ring_1[ring0count++] = linch0;
-			branch->ring_3[ring2count++] = linch0;
-			vertices[vertices_count++] = centerloc + tangent * radius * scale;
-
-			int start = static_cast<int>(vertices_count - 1);
-			glm::vec3 d1 = vecAxisAngle(tangent, axis2, 1.57f);
-			glm::vec3 d2 = normalize(cross(tangent, axis));
-			float s = 1 / dot(d1, d2);
-			for (int i = 1; i < segments / 2; i++) {
-				glm::vec3 vec = vecAxisAngle(tangent, axis2, segmentAngle * i);
-				branch->ring_1[ring0count++] = start + i;
-				branch->ring_3[ring2count++] = start + i;
-				vec = scaleInDirection(vec, d2, s);
-				vertices[vertices_count++] = centerloc + vec * radius * scale;
+		auto v1 = glm::normalize(vertices[skeleton.ring_2(branch)[0]] - branch.head);
+		auto v2 = glm::normalize(vertices[skeleton.ring_3(branch)[0]] - branch.head);
+
+		v1 = scaleInDirection(v1, glm::normalize(child_1.head - branch.head), 0);
+		v2 = scaleInDirection(v2, glm::normalize(child_2.head - branch.head), 0);
+
+		for (int i = 0; i < segments; i++) {
+			if (fork0) {
+				float l = glm::dot(glm::normalize(vertices[skeleton.ring_1(child_1)[i]] - child_1.head), v1);
+				if (segOffset0 == -1 || l > match0) {
+					match0 = l;
+					segOffset0 = segments - i;
+				}
 			}
-			int linch1 = static_cast<int>(vertices_count);
-			branch->ring_1[ring0count++] = linch1;
-			branch->ring_2[ring1count++] = linch1;
-			vertices[vertices_count++] = centerloc - tangent * radius * scale;
-			for (int i = segments / 2 + 1; i < segments; i++) {
-				glm::vec3 vec = vecAxisAngle(tangent, axis1, segmentAngle * i);
-				branch->ring_1[ring0count++] = static_cast<int>(vertices_count);
-				branch->ring_2[ring1count++] = static_cast<int>(vertices_count);
-				vertices[vertices_count++] = centerloc + vec * radius * scale;
+			if (fork1) {
+				float l = glm::dot(glm::normalize(vertices[skeleton.ring_1(child_2)[i]] - child_2.head), v2);
+				if (segOffset1 == -1 || l > match1) {
+					match1 = l;
+					segOffset1 = segments - i;
+				}
 			}
-			branch->ring_2[ring1count++] = linch0;
-			branch->ring_3[ring2count++] = linch1;
-			start = static_cast<int>(vertices_count - 1);
-			for (int i = 1; i < segments / 2; i++) {
-				branch->ring_2[ring1count++] = start + i;
-				branch->ring_3[ring2count++] = start + (segments / 2 - i);
-
-				glm::vec3 vec = vecAxisAngle(tangent, axis3, segmentAngle * i);
-				vertices[vertices_count++] = centerloc + vec * radius * scale;
+		}
+
+		for (int i = 0; i < segments; i++) {
+			if (fork0) {
+				int i1 = skeleton.ring_1(child_1)[i];
+				int i2 = skeleton.ring_2(branch)[(i + segOffset0 + 1) % segments];
+				int i3 = skeleton.ring_2(branch)[(i + segOffset0) % segments];
+				int i4 = skeleton.ring_1(child_1)[(i + 1) % segments];
+
+				face(i1, i4, i3);
+				face(i4, i2, i3);
+			} else {
+				face(child_1.last, skeleton.ring_2(branch)[(i + 1) % segments], skeleton.ring_2(branch)[i]);
 			}
 
-			//child radius is related to the brans direction and the length of the branch
-			//float length0 = length(sub(branch->head, branch->child_1->head)); // never used
-			//float length1 = length(sub(branch->head, branch->child_2->head)); // never used
+			if (fork1) {
+				int i1 = skeleton.ring_1(child_2)[i];
+				int i2 = skeleton.ring_3(branch)[(i + segOffset1 + 1) % segments];
+				int i3 = skeleton.ring_3(branch)[(i + segOffset1) % segments];
+				int i4 = skeleton.ring_1(child_2)[(i + 1) % segments];
 
-			float radius0 = 1 * radius * m_properties.radius_falloff_rate;
-			float radius1 = 1 * radius * m_properties.radius_falloff_rate;
-			if (branch->child_1->trunktype) {
-				radius0 = radius * m_properties.taper_rate;
+				face(i1, i2, i3);
+				face(i1, i4, i2);
+			} else {
+				face(child_2.last, skeleton.ring_3(branch)[(i + 1) % segments], skeleton.ring_3(branch)[i]);
 			}
-			createForks(branch->child_1, radius0);
-			createForks(branch->child_2, radius1);
-		} else {
-			branch->last = static_cast<int>(vertices_count);
-			vertices[vertices_count++] = (branch->head);
 		}
-	};
+	});
 
-	std::function<void(Branch*)> createTwigs;
-	createTwigs = [&](Branch* branch) -> void {
-		if (!branch->child_1) {
-			glm::vec3 tangent = glm::normalize(glm::cross(branch->parent->child_1->head - branch->parent->head, branch->parent->child_2->head - branch->parent->head));
-			glm::vec3 binormal = glm::normalize(branch->head - branch->parent->head);
-			//glm::vec3 normal = cross(tangent, binormal); //never used
+	std::fill(builder.colors.begin(), builder.colors.begin() + vertices_count, glm::vec3{81.0f / 255.0f, 56.0f / 255.0f, 56.0f / 255.0f});
+	std::fill(builder.colors.begin() + vertices_count, builder.colors.end(), glm::vec3{0.0f / 255.0f, 200.0f / 255.0f, 0.0f / 255.0f});
+}
 
-			int vert1 = vertices.size();
-			vertices.push_back(branch->head + tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch->length));
-			int vert2 = vertices.size();
-			vertices.push_back(branch->head - tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch->length));
-			int vert3 = vertices.size();
-			vertices.push_back(branch->head - tangent * m_properties.twig_scale - binormal * branch->length);
-			int vert4 = vertices.size();
-			vertices.push_back(branch->head + tangent * m_properties.twig_scale - binormal * branch->length);
-
-			int vert8 = static_cast<int>(vertices.size());
-			vertices.push_back(branch->head + tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch->length));
-			int vert7 = static_cast<int>(vertices.size());
-			vertices.push_back(branch->head - tangent * m_properties.twig_scale + binormal * (m_properties.twig_scale * 2 - branch->length));
-			int vert6 = static_cast<int>(vertices.size());
-			vertices.push_back(branch->head - tangent * m_properties.twig_scale - binormal * branch->length);
-			int vert5 = static_cast<int>(vertices.size());
-			vertices.push_back(branch->head + tangent * m_properties.twig_scale - binormal * branch->length);
-
-			faces.emplace_back(vert1, vert2, vert3);
-			faces.emplace_back(vert4, vert1, vert3);
-			faces.emplace_back(vert6, vert7, vert8);
-			faces.emplace_back(vert6, vert8, vert5);
-		} else {
-			createTwigs(branch->child_1);
-			createTwigs(branch->child_2);
+Mesh& ProcTreeLod::getMesh(const Camera& camera) {
+	auto offset = camera.transform.position - transform.position;
+	float distance = glm::length(offset);
+	float size = radius / (distance * std::tan(glm::radians(camera.fov) * 0.5f));
+
+	float threshold = screen_size;
+	if (size >= threshold) {
+		return mesh;
+	}
+	for (auto& level : levels) {
+		threshold *= 0.5f;
+		if (size >= threshold) {
+			return level;
 		}
-	};
+	}
 
-	vertices_count = 0;
-	calcVertSizes(root.get());
-	vertices.resize(vertices_count);
+	return impostor.view(glm::transpose(glm::mat3{transform.rotation_matrix()}) * offset);
+}
 
-	colors.reserve(vertices_count);
-	for (int i = 0; i < vertices_count; i++) {
-		colors.emplace_back(81.0f / 255.0f, 56.0f / 255.0f, 56.0f / 255.0f);
-	}
+static void grow(Skeleton& skeleton, const TreeProperties& m_properties) {
+	skeleton[0].head = glm::vec3{0, m_properties.trunk_length, 0};
+	skeleton[0].length = m_properties.initial_branch_length;
+	skeleton.split(0, 0, m_properties.levels, m_properties.tree_steps, m_properties);
+	ThreadPool::instance().wait(skeleton.group);
+}
 
+void generateProcTree(const TreeProperties& properties, MeshBuilder& builder) {
+	Skeleton skeleton{properties};
+	grow(skeleton, properties);
+	emit(skeleton, properties, builder);
+	optimizeMesh(builder, true);
+}
 
-	vertices_count = 0;
-	createForks(root.get(), 0);
-	createTriangles(root.get());
-	createTwigs(root.get());
+TreeSkeleton generateProcTreeSkeleton(const TreeProperties& properties) {
+	Skeleton skeleton{properties};
+	grow(skeleton, properties);
 
-	for (int i = colors.size(); i < vertices.size(); i++) {
-		colors.emplace_back(0.0f / 255.0f, 200.0f / 255.0f, 0.0f / 255.0f);
-	}
+	TreeSkeleton result{};
+	result.heads.reserve(skeleton.branches.size());
+	result.radii.reserve(skeleton.branches.size());
+	result.levels.reserve(skeleton.branches.size());
+	result.parents.reserve(skeleton.branches.size());
 
-	int normalCount[vertices.size()];
-	normals.resize(vertices.size());
-	for (auto const& face : faces) {
-		int i1 = face[0];
-		int i2 = face[1];
-		int i3 = face[2];
+	for (auto& branch : skeleton.branches) {
+		float radius = taper(skeleton, branch, properties);
 
-		auto normal = glm::normalize(glm::cross(vertices[i2] - vertices[i1], vertices[i3] - vertices[i1]));
+		result.heads.push_back(branch.head);
+		result.radii.push_back(radius);
+		result.levels.push_back(branch.child_1 != -1 ? branch.level : -1);
+		result.parents.push_back(branch.parent);
 
-		normals[i1] += normal;
-		normals[i2] += normal;
-		normals[i3] += normal;
+		result.min = glm::min(result.min, branch.head);
+		result.max = glm::max(result.max, branch.head);
+
+		if (branch.child_1 != -1) {
+			result.forks++;
+		} else {
+			result.twigs++;
+		}
 
-		normalCount[i1]++;
-		normalCount[i2]++;
-		normalCount[i3]++;
+		glm::vec3 base = branch.parent != -1 ? skeleton[branch.parent].head : glm::vec3{0, 0, 0};
+		result.total_length += glm::length(branch.head - base);
 	}
-//
-//	for (int i = 0; i < normals.size(); i++) {
-//		normals[i] /= normalCount[i];
-//	}
-
-	MeshBuilder builder;
-	builder.colors = colors;
-	builder.vertices = vertices;
-	builder.normals = normals;
-
-	for (auto &face : faces) {
-		builder.indices.emplace_back(face[0]);
-		builder.indices.emplace_back(face[1]);
-		builder.indices.emplace_back(face[2]);
+	return result;
+}
+
+std::vector<TreeSkeleton> generateProcTreeSkeletons(const std::vector<TreeProperties>& properties) {
+	std::vector<TreeSkeleton> skeletons(properties.size());
+	ThreadPool::instance().parallel_for(0, properties.size(), 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			skeletons[i] = generateProcTreeSkeleton(properties[i]);
+		}
+	});
+	return skeletons;
+}
+
+std::unique_ptr<GameObject> createProcTree(const glm::vec3& position, const std::optional<TreeProperties>& properties, const std::optional<TreeLod>& lod) {
+	auto m_properties = properties.value_or(TreeProperties{});
+
+	Skeleton skeleton{m_properties};
+	grow(skeleton, m_properties);
+
+	// trees are built around their own origin, close enough for half precision positions
+	MeshBuilder builder{};
+	builder.format = VertexFormat::local();
+	emit(skeleton, m_properties, builder);
+	optimizeMesh(builder, true);
+
+	if (!lod) {
+		auto object = std::make_unique<GameObject>();
+		object->mesh = builder.build();
+		object->mesh.shader = Shader::find("default_wood");
+		object->transform.position = position;
+		return std::move(object);
 	}
 
-	auto object = std::make_unique<GameObject>();
+	// meshlets are culled with the object's own transform, which instanced copies don't share
+	auto object = std::make_unique<ProcTreeLod>();
+	builder.meshlet_triangles = 128;
 	object->mesh = builder.build();
 	object->mesh.shader = Shader::find("default_wood");
 	object->transform.position = position;
+	object->screen_size = lod->screen_size;
+
+	for (auto const& vertex : object->mesh.geometry->vertices) {
+		object->radius = std::max(object->radius, glm::length(vertex));
+	}
+
+	// every level drops the outermost forks in favour of bigger twigs and two ring segments
+	for (int i = 1; i <= lod->meshes; i++) {
+		Skeleton pruned{skeleton, std::min(i, m_properties.levels), evenSegments(std::max(4, m_properties.segments - 2 * i))};
+
+		MeshBuilder reduced{};
+		reduced.format = VertexFormat::local();
+		reduced.meshlet_triangles = 128;
+		emit(pruned, m_properties, reduced);
+		optimizeMesh(reduced, true);
+
+		object->levels.push_back(reduced.build());
+		object->levels.back().shader = Shader::find("default_wood");
+	}
+
+	object->impostor = bakeImpostor(object->mesh, lod->impostor_views, lod->impostor_resolution);
 	return std::move(object);
 }
\ No newline at end of file
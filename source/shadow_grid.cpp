@@ -0,0 +1,97 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "shadow_grid.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
+
+ShadowGrid::ShadowGrid(const glm::vec3& min, const glm::vec3& max, float cell_size, int depth, float falloff)
+	: origin{min}, cell_size{cell_size}, depth{depth}, falloff{falloff} {
+	auto extent = (max - min) / cell_size;
+	width = static_cast<int>(std::ceil(extent.x)) + 1;
+	height = static_cast<int>(std::ceil(extent.y)) + 1;
+	length = static_cast<int>(std::ceil(extent.z)) + 1;
+	shadow.resize(static_cast<size_t>(width) * height * length, 0.0f);
+}
+
+bool ShadowGrid::voxel(const glm::vec3& position, int& x, int& y, int& z) const {
+	auto cell = (position - origin) / cell_size;
+	x = static_cast<int>(std::floor(cell.x));
+	y = static_cast<int>(std::floor(cell.y));
+	z = static_cast<int>(std::floor(cell.z));
+	return x >= 0 && y >= 0 && z >= 0 && x < width && y < height && z < length;
+}
+
+float ShadowGrid::at(int x, int y, int z) const {
+	if (x < 0 || y < 0 || z < 0 || x >= width || y >= height || z >= length) {
+		return 0.0f;
+	}
+	return shadow[(static_cast<size_t>(y) * length + z) * width + x];
+}
+
+void ShadowGrid::cast(const glm::vec3& position) {
+	int x, y, z;
+	if (!voxel(position, x, y, z)) {
+		return;
+	}
+
+	float strength = 1.0f;
+	for (int q = 0; q <= depth && y - q >= 0; q++) {
+		int layer = y - q;
+		for (int dz = std::max(-q, -z); dz <= q && z + dz < length; dz++) {
+			float* row = &shadow[(static_cast<size_t>(layer) * length + z + dz) * width];
+			for (int dx = std::max(-q, -x); dx <= q && x + dx < width; dx++) {
+				row[x + dx] += strength;
+			}
+		}
+		strength /= falloff;
+	}
+}
+
+float ShadowGrid::exposure(const glm::vec3& position, float full_light) const {
+	int x, y, z;
+	if (!voxel(position, x, y, z)) {
+		return full_light;
+	}
+
+	// a node's own voxel always holds its own unit of shadow, which should not shade it
+	return std::max(0.0f, full_light - at(x, y, z) + 1.0f);
+}
+
+glm::vec3 ShadowGrid::light(const glm::vec3& position) const {
+	int x, y, z;
+	if (!voxel(position, x, y, z)) {
+		return glm::vec3{0, 0, 0};
+	}
+
+	float best = at(x, y, z);
+	glm::vec3 direction{0, 0, 0};
+	for (int dy = -1; dy <= 1; dy++) {
+		for (int dz = -1; dz <= 1; dz++) {
+			for (int dx = -1; dx <= 1; dx++) {
+				float value = at(x + dx, y + dy, z + dz);
+				if (value < best) {
+					best = value;
+					direction = glm::normalize(glm::vec3{dx, dy, dz});
+				}
+			}
+		}
+	}
+	return direction;
+}
@@ -0,0 +1,31 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "spatial_grid.h"
+
+void SpatialGrid::insert(const glm::vec3& position, uint32_t id) {
+	cells[key(cell(position.x), cell(position.y), cell(position.z))].push_back(id);
+}
+
+void SpatialGrid::clear() {
+	cells.clear();
+}
+
+// 21 bits per axis, enough for two million cells in every direction
+uint64_t SpatialGrid::key(int64_t x, int64_t y, int64_t z) {
+	constexpr uint64_t mask = (uint64_t(1) << 21) - 1;
+	return (static_cast<uint64_t>(x) & mask) | (static_cast<uint64_t>(y) & mask) << 21 | (static_cast<uint64_t>(z) & mask) << 42;
+}
@@ -0,0 +1,125 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "thread_pool.h"
+
+static thread_local const ThreadPool* worker_pool = nullptr;
+static thread_local size_t worker_index = 0;
+
+ThreadPool::ThreadPool(size_t threads) {
+	size_t count = threads > 1 ? threads - 1 : 0;
+
+	// the last queue belongs to threads outside of the pool
+	for (size_t i = 0; i <= count; i++) {
+		queues.push_back(std::make_unique<Queue>());
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		workers.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		running = false;
+	}
+	condition.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::instance() {
+	static ThreadPool pool{};
+	return pool;
+}
+
+size_t ThreadPool::current() const {
+	return worker_pool == this ? worker_index : workers.size();
+}
+
+void ThreadPool::submit(TaskGroup& group, Task task) {
+	group.pending++;
+
+	auto& queue = *queues[current()];
+	{
+		std::lock_guard<std::mutex> lock{queue.mutex};
+		queue.tasks.emplace_back(&group, std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> lock{mutex};
+		queued++;
+	}
+	condition.notify_one();
+}
+
+void ThreadPool::wait(TaskGroup& group) {
+	size_t self = current();
+	while (group.pending > 0) {
+		if (!run(self)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+bool ThreadPool::run(size_t self) {
+	std::pair<TaskGroup*, Task> task{};
+
+	for (size_t i = 0; i < queues.size() && !task.first; i++) {
+		auto& queue = *queues[(self + i) % queues.size()];
+
+		std::lock_guard<std::mutex> lock{queue.mutex};
+		if (queue.tasks.empty()) {
+			continue;
+		}
+
+		if (i == 0) {
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (!task.first) {
+		return false;
+	}
+
+	queued--;
+	task.second();
+	task.first->pending--;
+	return true;
+}
+
+void ThreadPool::work(size_t self) {
+	worker_pool = this;
+	worker_index = self;
+
+	while (true) {
+		if (run(self)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock{mutex};
+		condition.wait(lock, [this] { return !running || queued > 0; });
+		if (!running) {
+			return;
+		}
+	}
+}
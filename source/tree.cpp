@@ -18,10 +18,14 @@ limitations under the License.
 #include "tree.h"
 
 #include "mesh_builder.h"
-
-#include <random>
-#include <chrono>
-
+#include "mesh_optimizer.h"
+#include "random.h"
+#include "spatial_grid.h"
+#include "shadow_grid.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 #include <functional>
@@ -30,20 +34,31 @@ limitations under the License.
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/euler_angles.hpp>
+#include <glm/common.hpp>
 
 struct leaf_t {
-	glm::vec3 pos;
+	glm::vec3 pos{};
 	bool reached = false;
+	leaf_t() = default;
 	leaf_t(const glm::vec3& pos) : pos{pos} {}
 };
 
+struct attraction_t {
+	uint32_t branch;
+	glm::vec3 dir;
+};
+
+static constexpr size_t chunk_size = 256;
+
 struct branch_t {
-	std::optional<glm::vec3> start;
 	glm::vec3 pos;
+	int parent = -1;
+	int tree = 0;
+	float radius = 0;
 	glm::vec3 dir = {0, 0, 0};
 	size_t count = 0;
 
-	explicit branch_t(const glm::vec3& pos, const std::optional<glm::vec3>& start = std::nullopt) : pos{pos}, start{start} {}
+	explicit branch_t(const glm::vec3& pos, int parent = -1, int tree = 0) : pos{pos}, parent{parent}, tree{tree} {}
 
 	void reset() {
 		dir = {0, 0, 0};
@@ -51,193 +66,445 @@ struct branch_t {
 	}
 };
 
-branch_t grow_branch(const branch_t &branch, const glm::vec3 &dir) {
-	return branch_t{branch.pos + dir, branch.pos};
+branch_t grow_branch(const branch_t &branch, int index, const glm::vec3 &dir) {
+	return branch_t{branch.pos + dir, index, branch.tree};
 }
 
-//todo: generate solid mesh
-std::unique_ptr<GameObject> createTree(const glm::vec3& position) {
-	std::default_random_engine random_engine{static_cast<unsigned long>(std::chrono::high_resolution_clock::now().time_since_epoch().count())};
+// Pipe model: a node carries the cross sections of everything above it, r^e = sum of children r^e.
+// Children are always appended after their parent, so one reverse pass settles every radius.
+static void pipe_radii(std::vector<branch_t>& branches, const ColonizationProperties& properties) {
+	std::vector<float> area(branches.size(), 0.0f);
 
-	auto random_value = [&](double max = 1.0) -> double {
-		return (static_cast<double>(random_engine()) / static_cast<double>(std::default_random_engine::max())) * max;
-	};
-
-	MeshBuilder builder{};
+	for (size_t i = branches.size(); i-- > 0;) {
+		auto& branch = branches[i];
+		if (area[i] == 0) {
+			area[i] = std::pow(properties.tip_radius, properties.pipe_exponent);
+		}
+		branch.radius = std::pow(area[i], 1.0f / properties.pipe_exponent);
 
-	auto create_branch_mesh = [&](const glm::vec3& start, const glm::vec3& end, float radius, float segment_height, int segments) {
-		auto index = builder.vertices.size();
-//
-//		builder.vertices.push_back(start);
-//		builder.vertices.push_back(end);
-//
-//		builder.indices.push_back(index);
-//		builder.indices.push_back(index + 1);
+		if (branch.parent != -1) {
+			area[branch.parent] += area[i];
+		}
+	}
+}
 
-		float distance = glm::distance(end, start);
-		segment_height = distance / 10.0f;
-//
-		int segments_per_height = static_cast<int>(distance / segment_height);
+// One indexed tube mesh per tree, relative to its origin. Every node continues the chain of its
+// thickest child, other children start chains of their own at the parent node; rings along a chain
+// are shared by consecutive segments and oriented by rotation-minimizing (double reflection)
+// frames, and chains end in a tip.
+static void tube(const std::vector<branch_t>& branches, const ColonizationProperties& properties, const std::vector<glm::vec3>& origins, std::vector<MeshBuilder>& builders) {
+	int segments = properties.segments;
+
+	std::vector<int> next(branches.size(), -1);
+	for (size_t i = 0; i < branches.size(); i++) {
+		int parent = branches[i].parent;
+		if (parent != -1 && (next[parent] == -1 || branches[i].radius > branches[next[parent]].radius)) {
+			next[parent] = static_cast<int>(i);
+		}
+	}
 
-		auto dir = end - start;
-		auto part = dir / static_cast<float>(segments_per_height);
+	std::vector<std::vector<size_t>> chains(builders.size());
+	for (size_t i = 0; i < branches.size(); i++) {
+		int parent = branches[i].parent;
+		if (parent == -1 || next[parent] != static_cast<int>(i)) {
+			chains[branches[i].tree].push_back(i);
+		}
+	}
 
-		auto n = glm::normalize(dir);
+	std::vector<float> cos(segments);
+	std::vector<float> sin(segments);
+	for (int j = 0; j < segments; j++) {
+		auto angle = static_cast<float>(M_PI * 2 * j / segments);
+		cos[j] = std::cos(angle);
+		sin[j] = std::sin(angle);
+	}
 
+	ThreadPool::instance().parallel_for(0, builders.size(), 1, [&](size_t begin, size_t end) {
+		std::vector<glm::vec3> points{};
+		std::vector<float> radii{};
 
-		float segment = 360.0f / segments;
-		auto s = start;
-		for (int j = 0; j < segments_per_height; j++) {
-			for (int i = 0; i < segments; i++) {
-				float angle = glm::radians(segment * i);
+		for (size_t t = begin; t < end; t++) {
+			auto& builder = builders[t];
 
-				glm::vec3 point{radius * glm::cos(angle), static_cast<float>(j) * segment_height, radius * glm::sin(angle)};
+			for (auto i : chains[t]) {
+				int parent = branches[i].parent;
 
-//				point = glm::cross(n, point);
+				points.clear();
+				radii.clear();
+				if (parent != -1) {
+					points.push_back(branches[parent].pos - origins[t]);
+					radii.push_back(branches[i].radius);
+				}
+				for (int node = static_cast<int>(i); node != -1; node = next[node]) {
+					points.push_back(branches[node].pos - origins[t]);
+					radii.push_back(branches[node].radius);
+				}
+				if (points.size() < 2) {
+					continue;
+				}
 
+				size_t rings = points.size();
+				auto tangent_at = [&](size_t r) {
+					if (r == 0) {
+						return glm::normalize(points[1] - points[0]);
+					}
+					if (r == rings - 1) {
+						return glm::normalize(points[r] - points[r - 1]);
+					}
+					return glm::normalize(glm::normalize(points[r] - points[r - 1]) + glm::normalize(points[r + 1] - points[r]));
+				};
+
+				glm::vec3 tangent = tangent_at(0);
+				glm::vec3 helper = std::abs(tangent.y) < 0.9f ? glm::vec3{0, 1, 0} : glm::vec3{1, 0, 0};
+				glm::vec3 normal = glm::normalize(glm::cross(helper, tangent));
+
+				auto base = static_cast<uint32_t>(builder.vertices.size());
+				for (size_t r = 0; r < rings; r++) {
+					if (r > 0) {
+						glm::vec3 t = tangent_at(r);
+						glm::vec3 v1 = points[r] - points[r - 1];
+						float c1 = glm::dot(v1, v1);
+						glm::vec3 normal_l = normal - v1 * (2 / c1 * glm::dot(v1, normal));
+						glm::vec3 tangent_l = tangent - v1 * (2 / c1 * glm::dot(v1, tangent));
+						glm::vec3 v2 = t - tangent_l;
+						float c2 = glm::dot(v2, v2);
+						normal = c2 > 0 ? normal_l - v2 * (2 / c2 * glm::dot(v2, normal_l)) : normal_l;
+						tangent = t;
+					}
+
+					glm::vec3 binormal = glm::cross(tangent, normal);
+					for (int j = 0; j < segments; j++) {
+						glm::vec3 radial = normal * cos[j] + binormal * sin[j];
+						builder.vertices.push_back(points[r] + radial * radii[r]);
+						builder.normals.push_back(radial);
+					}
+				}
 
+				for (size_t r = 0; r + 1 < rings; r++) {
+					for (int j = 0; j < segments; j++) {
+						auto i0 = base + static_cast<uint32_t>(r * segments + j);
+						auto i1 = base + static_cast<uint32_t>(r * segments + (j + 1) % segments);
+						auto i2 = i0 + segments;
+						auto i3 = i1 + segments;
 
-//
-//				point = rotate * glm::vec4(point, 1.0f);
+						builder.indices.insert(builder.indices.end(), {i0, i1, i2, i1, i3, i2});
+					}
+				}
 
+				auto last = base + static_cast<uint32_t>((rings - 1) * segments);
+				auto tip = static_cast<uint32_t>(builder.vertices.size());
+				builder.vertices.push_back(points.back() + tangent * radii.back());
+				builder.normals.push_back(tangent);
+				for (int j = 0; j < segments; j++) {
+					builder.indices.insert(builder.indices.end(), {last + j, last + (j + 1) % segments, tip});
+				}
+			}
 
+			builder.colors.assign(builder.vertices.size(), glm::vec3{81.0f / 255.0f, 56.0f / 255.0f, 56.0f / 255.0f});
+			builder.format = VertexFormat::compact();
+			optimizeMesh(builder, true);
+		}
+	});
+}
 
+// Grows every root in branches against one shared set of points. Nodes of all trees live in the
+// same grid, so trees compete for points and the cost follows the point count, not trees x points.
+static void colonize(std::vector<branch_t>& branches, std::vector<leaf_t>& leaves, const ColonizationProperties& m_properties) {
+	const float min_dist = m_properties.min_dist;
+	const float max_dist = m_properties.max_dist;
 
-				glm::mat4x4 translate = glm::translate(glm::mat4x4(1.0f), point);
-				glm::mat4x4 rotate = glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), n, glm::vec3(0.0f, 1.0f, 0.0f));
-				point = translate * rotate * glm::vec4(point, 1.0f);
+	if (leaves.empty()) {
+		return;
+	}
 
-				float x = s.x + point.x;
-				float y = s.y + point.y;
-				float z = s.z + point.z;
+	// every root first grows straight up until some point is within reach; points the trunk has
+	// already climbed past can never come within reach again
+	SpatialGrid points{max_dist};
+	float top = leaves[0].pos.y;
+	for (size_t l = 0; l < leaves.size(); l++) {
+		points.insert(leaves[l].pos, static_cast<uint32_t>(l));
+		top = std::max(top, leaves[l].pos.y);
+	}
 
-//				float y = y0 * cos_alpha + z0 * sin_alpha + start.y;
-//				float z = z0 * cos_alpha - y0 * sin_alpha + start.z;
+	size_t roots = branches.size();
+	for (size_t r = 0; r < roots; r++) {
+		auto trunk = static_cast<int>(r);
 
-				builder.indices.push_back(builder.vertices.size());
-				builder.vertices.emplace_back(x, y, z);
+		while (branches[trunk].pos.y <= top + max_dist) {
+			bool found = false;
+			points.query(branches[trunk].pos, [&](uint32_t l) {
+				found = found || glm::distance(leaves[l].pos, branches[trunk].pos) < max_dist;
+			});
+			if (found) {
+				break;
 			}
-			s += part;
-		}
-
-//		for (int j = 0; j < segments_per_height; j++) {
-//			for (int i = 0; i < segments; i++) {
-//				auto corner0 = index + i + j * segments;
-//				auto corner1 = corner0 + segments;
-//				auto corner2 = index + (1 + i) % segments + j * segments;
-//				auto corner3 = corner2 + segments;
-//
-//				builder.indices.push_back(corner0);
-//				builder.indices.push_back(corner1);
-//				builder.indices.push_back(corner2);
-//
-//				builder.indices.push_back(corner2);
-//				builder.indices.push_back(corner1);
-//				builder.indices.push_back(corner3);
-//			}
-
-//				builder.indices.push_back(index + j);
-//		}
-	};
-
-	auto createBranch = [&](const branch_t& branch) -> void {
-		if (branch.start) {
-			create_branch_mesh(branch.start.value(), branch.pos, 0.5f, 0.1f, 10);
-		}
-	};
 
-	std::vector<leaf_t> leaves{};
-	std::vector<branch_t> branches{};
-
-	for (int i = 0; i < 500; i++) {
-		double x = random_value(50) - 25;
-		double y = random_value(50) - 25;
-		double z = random_value(50) - 25;
+			branches.push_back(grow_branch(branches[trunk], trunk, glm::vec3{0.0f, 5.0f, 0.0f}));
+			trunk = static_cast<int>(branches.size() - 1);
+		}
+	}
 
-		leaves.emplace_back(glm::vec3{x, y, z});
+	// the grid holds the active front only. Nodes never move and points only die, so a node that
+	// is no live point's nearest can never become one again; only nodes pulled in the last
+	// iteration and the nodes they grew can still attract or kill anything
+	SpatialGrid grid{max_dist};
+	for (size_t b = 0; b < branches.size(); b++) {
+		grid.insert(branches[b].pos, static_cast<uint32_t>(b));
 	}
 
-	branch_t root {glm::vec3{0, -50, 0}};
+	std::vector<uint32_t> front{};
+	std::vector<branch_t> grown{};
+
+	// shadow propagation: the voxels span points and nodes, padded by the reach of a pyramid
+	std::optional<ShadowGrid> shadows{};
+	if (m_properties.shadow) {
+		glm::vec3 min = branches[0].pos;
+		glm::vec3 max = branches[0].pos;
+		for (auto const& leaf : leaves) {
+			min = glm::min(min, leaf.pos);
+			max = glm::max(max, leaf.pos);
+		}
+		for (auto const& branch : branches) {
+			min = glm::min(min, branch.pos);
+			max = glm::max(max, branch.pos);
+		}
 
-	branches.push_back(root);
+		glm::vec3 margin{m_properties.shadow_cell * static_cast<float>(m_properties.shadow_depth) + max_dist};
+		shadows.emplace(min - margin, max + margin, m_properties.shadow_cell, m_properties.shadow_depth);
 
-	constexpr double min_dist = 10.0;
-	constexpr double max_dist = 25.0;
+		for (auto const& branch : branches) {
+			shadows->cast(branch.pos);
+		}
+	}
 
-	auto current = &root;
+	// leaves are processed in fixed chunks: each task records its chunk's pulls in leaf order and
+	// counts the survivors, so the reduction and the compaction below see the same sequence as a
+	// serial scan no matter how many threads ran the chunks
+	auto& pool = ThreadPool::instance();
+	std::vector<std::vector<attraction_t>> attractions{};
+	std::vector<size_t> survivors{};
+	std::vector<leaf_t> next_leaves{};
 
-	bool found = false;
-	while (!found) {
-		for (auto& leaf : leaves) {
-			auto dist = glm::distance(leaf.pos, current->pos);
+	for (int i = 0; i < m_properties.iterations; i++) {
+		if (leaves.empty()) break;
 
-			if (dist < max_dist) {
-				found = true;
-				break;
+		size_t chunks = (leaves.size() + chunk_size - 1) / chunk_size;
+		attractions.resize(chunks);
+		survivors.resize(chunks + 1);
+
+		pool.parallel_for(0, chunks, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				attractions[c].clear();
+				survivors[c + 1] = 0;
+
+				size_t last = std::min(leaves.size(), (c + 1) * chunk_size);
+				for (size_t l = c * chunk_size; l < last; l++) {
+					auto& leaf = leaves[l];
+					int64_t closest = -1;
+					double m_dist = 0;
+
+					// cells come in no particular order, ties go to the oldest branch as in a linear scan
+					grid.query(leaf.pos, [&](uint32_t index) {
+						if (leaf.reached) {
+							return;
+						}
+
+						auto dist = glm::distance(leaf.pos, branches[index].pos);
+
+						if (dist > max_dist) {
+							return;
+						}
+
+						if (dist < min_dist) {
+							leaf.reached = true;
+							return;
+						}
+
+						if (closest == -1 || m_dist > dist || (m_dist == dist && index < closest)) {
+							closest = index;
+							m_dist = dist;
+						}
+					});
+
+					if (leaf.reached) {
+						continue;
+					}
+
+					survivors[c + 1]++;
+					if (closest != -1) {
+						attractions[c].push_back({static_cast<uint32_t>(closest), glm::normalize(leaf.pos - branches[closest].pos)});
+					}
+				}
+			}
+		});
+
+		for (auto const& chunk : attractions) {
+			for (auto const& attraction : chunk) {
+				auto& branch = branches[attraction.branch];
+				if (branch.count++ == 0) {
+					front.push_back(attraction.branch);
+				}
+				branch.dir += attraction.dir;
 			}
 		}
 
-		if (!found) {
-			branches.push_back(grow_branch(*current, glm::vec3{0.0f, 5.0f, 0.0f}));
-			current = &branches.back();
+		survivors[0] = 0;
+		for (size_t c = 0; c < chunks; c++) {
+			survivors[c + 1] += survivors[c];
 		}
-	}
 
-	for (int i = 0; i < 1000; i++) {
-		if (leaves.empty()) break;
+		next_leaves.resize(survivors[chunks]);
+		pool.parallel_for(0, chunks, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; c++) {
+				size_t last = std::min(leaves.size(), (c + 1) * chunk_size);
+				size_t out = survivors[c];
+				for (size_t l = c * chunk_size; l < last; l++) {
+					if (!leaves[l].reached) {
+						next_leaves[out++] = leaves[l];
+					}
+				}
+			}
+		});
+		leaves.swap(next_leaves);
 
-		for (auto &leaf : leaves) {
-			branch_t* closest = nullptr;
-			double m_dist = 0;
+		// nothing pulled means nothing grows, and every later iteration would repeat this one
+		if (front.empty()) {
+			break;
+		}
 
-			for (auto& branch : branches) {
-				auto dist = glm::distance(leaf.pos, branch.pos);
+		// new nodes are appended in the order of their parents
+		std::sort(front.begin(), front.end());
 
-				if (dist > max_dist) {
-					continue;
-				}
+		grown.clear();
+		grid.clear();
+		for (auto index : front) {
+			auto& branch = branches[index];
+			auto dir = glm::normalize(branch.dir / static_cast<float>(branch.count));
 
-				if (dist < min_dist) {
-					leaf.reached = true;
-					break;
-				}
+			grid.insert(branch.pos, index);
 
-				if (!closest || (m_dist > dist)) {
-					closest = &branch;
-					m_dist = dist;
-				}
+			// buds in deep shade stay dormant, the others bend towards the lighter neighbour voxels
+			bool dormant = false;
+			if (shadows) {
+				dormant = shadows->exposure(branch.pos, m_properties.full_light) <= 0;
+				dir = glm::normalize(dir + shadows->light(branch.pos) * m_properties.light_weight);
 			}
 
-			if (!leaf.reached && closest) {
-				auto dir = glm::normalize(leaf.pos - closest->pos);
-				closest->dir += dir;
-				closest->count++;
+			if (!dormant) {
+				grown.push_back(grow_branch(branch, static_cast<int>(index), dir));
 			}
+			branch.reset();
 		}
+		front.clear();
 
-		leaves.erase(std::remove_if(leaves.begin(), leaves.end(), [](const leaf_t &leaf) { return leaf.reached; }), leaves.end());
-
-		for (auto& branch : branches) {
-			if (branch.count > 0) {
-				auto dir = glm::normalize(branch.dir / static_cast<float>(branch.count));
+		for (auto& branch : grown) {
+			grid.insert(branch.pos, static_cast<uint32_t>(branches.size()));
+			branches.push_back(branch);
 
-				branches.push_back(grow_branch(branch, dir));
+			if (shadows) {
+				shadows->cast(branch.pos);
 			}
+		}
 
-			branch.reset();
+		// every pulled bud is dormant, so later iterations would repeat this one
+		if (grown.empty()) {
+			break;
 		}
 	}
+}
 
-	std::cout << branches.size() << std::endl;
+std::unique_ptr<GameObject> createTree(const glm::vec3& position, const std::optional<ColonizationProperties>& properties) {
+	auto m_properties = properties.value_or(ColonizationProperties{});
+	Random random{m_properties.seed};
+
+	std::vector<leaf_t> leaves{};
+	std::vector<branch_t> branches{};
 
-	for (auto const& branch : branches) {
-		createBranch(branch);
+	float half_size = m_properties.crown_size * 0.5f;
+	for (int i = 0; i < m_properties.attraction_points; i++) {
+		float x = random.range(i * 3 + 0, -half_size, half_size);
+		float y = random.range(i * 3 + 1, -half_size, half_size);
+		float z = random.range(i * 3 + 2, -half_size, half_size);
+
+		leaves.emplace_back(glm::vec3{x, y, z});
 	}
 
+	branches.emplace_back(glm::vec3{0, -m_properties.crown_size, 0});
+
+	colonize(branches, leaves, m_properties);
+
+	pipe_radii(branches, m_properties);
+
+	std::vector<MeshBuilder> builders(1);
+	tube(branches, m_properties, {glm::vec3{0, 0, 0}}, builders);
+
 	auto object = std::make_unique<GameObject>();
-	object->mesh = builder.build();
-	object->mesh.shader = Shader::find("default");
-	object->mesh.mode = GL_LINES;
+	object->mesh = builders[0].build();
+	object->mesh.shader = Shader::find("default_wood");
 	object->transform.position = position;
 	return std::move(object);
-}
\ No newline at end of file
+}
+
+std::vector<std::unique_ptr<GameObject>> createColonizationForest(const std::vector<glm::vec3>& positions, const std::optional<ColonizationProperties>& properties) {
+	auto m_properties = properties.value_or(ColonizationProperties{});
+	Random random{m_properties.seed};
+
+	std::vector<leaf_t> leaves{};
+	std::vector<branch_t> branches{};
+
+	if (positions.empty()) {
+		return {};
+	}
+
+	// every position samples its own crown-sized cube with its own stream, so empty space between
+	// trees costs nothing; where cubes overlap only the first one keeps its points, which holds the
+	// density of a single crown
+	float half_size = m_properties.crown_size * 0.5f;
+	SpatialGrid crowns{m_properties.crown_size};
+	for (size_t t = 0; t < positions.size(); t++) {
+		crowns.insert(positions[t], static_cast<uint32_t>(t));
+	}
+
+	leaves.reserve(static_cast<size_t>(std::max(m_properties.attraction_points, 0)) * positions.size());
+	for (size_t t = 0; t < positions.size(); t++) {
+		auto crown = random.fork(t);
+
+		for (int i = 0; i < m_properties.attraction_points; i++) {
+			glm::vec3 point = positions[t] + glm::vec3{
+				crown.range(i * 3 + 0, -half_size, half_size),
+				crown.range(i * 3 + 1, -half_size, half_size),
+				crown.range(i * 3 + 2, -half_size, half_size)
+			};
+
+			bool claimed = false;
+			crowns.query(point, [&](uint32_t other) {
+				auto offset = glm::abs(point - positions[other]);
+				claimed = claimed || (other < t && std::max({offset.x, offset.y, offset.z}) < half_size);
+			});
+			if (!claimed) {
+				leaves.emplace_back(point);
+			}
+		}
+	}
+
+	for (size_t t = 0; t < positions.size(); t++) {
+		branches.emplace_back(positions[t] - glm::vec3{0, m_properties.crown_size, 0}, -1, static_cast<int>(t));
+	}
+
+	colonize(branches, leaves, m_properties);
+
+	pipe_radii(branches, m_properties);
+
+	std::vector<MeshBuilder> builders(positions.size());
+	tube(branches, m_properties, positions, builders);
+
+	std::vector<std::unique_ptr<GameObject>> objects{};
+	for (size_t t = 0; t < positions.size(); t++) {
+		auto object = std::make_unique<GameObject>();
+		object->mesh = builders[t].build();
+		object->mesh.shader = Shader::find("default_wood");
+		object->transform.position = positions[t];
+		objects.push_back(std::move(object));
+	}
+	return objects;
+}
@@ -0,0 +1,145 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include "upload_ring.h"
+#include "timer.h"
+
+UploadStats& UploadStats::operator+=(const UploadStats& other) {
+	bytes += other.bytes;
+	allocations += other.allocations;
+	stalls += other.stalls;
+	stall_seconds += other.stall_seconds;
+	padding += other.padding;
+	failures += other.failures;
+	return *this;
+}
+
+UploadRing::UploadRing(size_t capacity) : capacity{capacity} {
+	glGenBuffers(1, &buffer);
+
+	// the copy target leaves the element binding of whatever VAO is bound alone
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, capacity, nullptr, flags);
+		mapped = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, capacity, flags));
+	} else {
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+		shadow.resize(capacity);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+UploadRing::~UploadRing() {
+	for (auto& frame : frames) {
+		glDeleteSync(frame.fence);
+	}
+	if (mapped) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &buffer);
+}
+
+UploadAllocation UploadRing::allocate(size_t size, size_t alignment) {
+	size_t offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > capacity) {
+		offset = 0;
+	}
+	size_t padding = offset >= head ? offset - head : capacity - head;
+
+	// only finished frames can be waited away, this one stays
+	if (pending + padding + size > capacity) {
+		frame.failures++;
+		return {};
+	}
+	while (used + padding + size > capacity) {
+		retire(true);
+	}
+
+	head = offset + size;
+	used += padding + size;
+	pending += padding + size;
+
+	frame.bytes += size;
+	frame.allocations++;
+	frame.padding += padding;
+
+	UploadAllocation allocation{};
+	allocation.data = (mapped ? mapped : shadow.data()) + offset;
+	allocation.offset = static_cast<GLintptr>(offset);
+	allocation.size = static_cast<GLsizeiptr>(size);
+	if (!mapped) {
+		dirty.push_back(allocation);
+	}
+	return allocation;
+}
+
+void UploadRing::flush() {
+	if (dirty.empty()) {
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	for (auto const& allocation : dirty) {
+		glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.offset, allocation.size, allocation.data);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	dirty.clear();
+}
+
+void UploadRing::endFrame() {
+	flush();
+
+	if (pending > 0) {
+		frames.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), pending});
+		pending = 0;
+	}
+
+	// whatever the GPU is already done with is free without waiting
+	while (retire(false)) {
+	}
+
+	last_frame = frame;
+	total += frame;
+	frame = {};
+}
+
+bool UploadRing::retire(bool wait) {
+	if (frames.empty()) {
+		return false;
+	}
+
+	auto& oldest = frames.front();
+	if (glClientWaitSync(oldest.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+		if (!wait) {
+			return false;
+		}
+
+		Timer timer{};
+		while (glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {
+		}
+		frame.stalls++;
+		frame.stall_seconds += timer.elapsed();
+	}
+
+	glDeleteSync(oldest.fence);
+	used -= oldest.bytes;
+	frames.pop_front();
+	return true;
+}
@@ -0,0 +1,117 @@
+/*
+Copyright 2019 Maxim Pasichnyk
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "vertex_format.h"
+#include "thread_pool.h"
+
+#include <cstring>
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+
+// vertices per encoding task
+static constexpr size_t encode_grain = 1 << 14;
+
+VertexFormat VertexFormat::compact() {
+	return {POSITION_FLOAT, NORMAL_PACKED, COLOR_RGBA8};
+}
+
+VertexFormat VertexFormat::local() {
+	return {POSITION_HALF, NORMAL_PACKED, COLOR_RGBA8};
+}
+
+size_t VertexFormat::normalOffset() const {
+	return position == POSITION_HALF ? 4 * sizeof(uint16_t) : sizeof(glm::vec3);
+}
+
+size_t VertexFormat::colorOffset() const {
+	return normalOffset() + (normal == NORMAL_PACKED ? sizeof(uint32_t) : sizeof(glm::vec3));
+}
+
+size_t VertexFormat::stride() const {
+	return colorOffset() + (color == COLOR_RGBA8 ? sizeof(uint32_t) : sizeof(glm::vec3));
+}
+
+void VertexFormat::bind(size_t offset) const {
+	auto size = static_cast<GLsizei>(stride());
+
+	if (position == POSITION_HALF) {
+		glVertexAttribPointer(0, 4, GL_HALF_FLOAT, GL_FALSE, size, reinterpret_cast<void*>(offset));
+	} else {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, size, reinterpret_cast<void*>(offset));
+	}
+
+	if (color == COLOR_RGBA8) {
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, size, reinterpret_cast<void*>(offset + colorOffset()));
+	} else {
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, size, reinterpret_cast<void*>(offset + colorOffset()));
+	}
+
+	if (normal == NORMAL_PACKED) {
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, size, reinterpret_cast<void*>(offset + normalOffset()));
+	} else {
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, size, reinterpret_cast<void*>(offset + normalOffset()));
+	}
+}
+
+std::vector<uint8_t> VertexFormat::encode(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& colors, const std::vector<glm::vec3>& normals) const {
+	std::vector<uint8_t> data(vertices.size() * stride());
+	encode(vertices, colors, normals, data.data());
+	return data;
+}
+
+void VertexFormat::encode(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& colors, const std::vector<glm::vec3>& normals, uint8_t* data) const {
+	size_t size = stride();
+	size_t normal_offset = normalOffset();
+	size_t color_offset = colorOffset();
+
+	ThreadPool::instance().parallel_for(0, vertices.size(), encode_grain, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			uint8_t* out = data + i * size;
+
+			if (position == POSITION_HALF) {
+				uint16_t half[4] = {
+					glm::packHalf1x16(vertices[i].x),
+					glm::packHalf1x16(vertices[i].y),
+					glm::packHalf1x16(vertices[i].z),
+					glm::packHalf1x16(1.0f)
+				};
+				std::memcpy(out, half, sizeof(half));
+			} else {
+				std::memcpy(out, &vertices[i], sizeof(glm::vec3));
+			}
+
+			glm::vec3 normal_value = i < normals.size() ? normals[i] : glm::vec3{0, 0, 0};
+			if (normal == NORMAL_PACKED) {
+				// snorm clamps every axis on its own, which bends any normal longer than one
+				float length = glm::length(normal_value);
+				glm::vec3 unit = length > 0 ? normal_value / length : glm::vec3{0, 0, 0};
+				uint32_t packed = glm::packSnorm3x10_1x2(glm::vec4{unit, 0.0f});
+				std::memcpy(out + normal_offset, &packed, sizeof(packed));
+			} else {
+				std::memcpy(out + normal_offset, &normal_value, sizeof(glm::vec3));
+			}
+
+			glm::vec3 color_value = i < colors.size() ? colors[i] : glm::vec3{0, 0, 0};
+			if (color == COLOR_RGBA8) {
+				uint32_t packed = glm::packUnorm4x8(glm::vec4{color_value, 1.0f});
+				std::memcpy(out + color_offset, &packed, sizeof(packed));
+			} else {
+				std::memcpy(out + color_offset, &color_value, sizeof(glm::vec3));
+			}
+		}
+	});
+}